@@ -0,0 +1,57 @@
+/*
+ * bench.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Packet helpers shared by the benchmarks, linked with
+ * each of them rather than built on its own
+ */
+
+#include "bench.h"
+#include "scramble.h"
+#include "fir.h"
+
+// Functions
+
+/*
+ * One packet carrying bytes, a preamble, NS data blocks
+ * and a gap, returns the samples. The bytes are scrambled
+ * on the way out and left as they were.
+ */
+int bench_packet(int16_t out[], const uint8_t bytes[]) {
+    uint8_t scrambled[BYTES_PER_FRAME];
+    int length = qpsk_tx_preamble(out);
+
+    memcpy(scrambled, bytes, BYTES_PER_FRAME);
+    scramble_bytes(scrambled, BYTES_PER_FRAME);
+
+    for (int j = 0; j < NS; j++) {
+        length += qpsk_tx_packed(&out[length], scrambled, (j * DATA_SYMBOLS), DATA_SYMBOLS, false);
+    }
+
+    memset(&out[length], 0, sizeof (int16_t) * GAP_SIZE);
+
+    return length + GAP_SIZE;
+}
+
+/*
+ * Receiver sync expected for a packet starting at sample start
+ * of the channel input, its first preamble symbol delayed half
+ * the transmit filter, by the clock skew and by the Hilbert filter
+ */
+int64_t bench_sync_peak(const Channel *ch, int64_t start) {
+    double peak = (double) (start + ((NTAPS - 1) / 2)) / ch->skew_step;
+
+    return (int64_t) llround(peak) + ((CHANNEL_HILBERT - 1) / 2);
+}
+
+int bench_bit_errors(const uint8_t a[], const uint8_t b[], int bits) {
+    int errors = 0;
+
+    for (int i = 0; i < bits; i++) {
+        errors += ((a[i >> 3] ^ b[i >> 3]) >> (i & 7)) & 1;
+    }
+
+    return errors;
+}
@@ -0,0 +1,39 @@
+/*
+ * bench.h
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qpsk_internal.h"
+#include "channel.h"
+
+// Defines
+
+/*
+ * Gap between packets, as in the loopback test
+ */
+#define GAP_SIZE            903
+#define PACKET_SIZE         (PREAMBLE_SIZE + (NS * DATA_SYMBOLS * CYCLESF) + GAP_SIZE)
+
+/*
+ * Bits checked in each decoded frame, the receiver
+ * returns the first DATA_SYMBOLS after the preamble
+ */
+#define CHECK_BITS          (DATA_SYMBOLS * 2)
+
+// Prototypes
+
+int bench_packet(int16_t [], const uint8_t []);
+int64_t bench_sync_peak(const Channel *, int64_t);
+int bench_bit_errors(const uint8_t [], const uint8_t [], int);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,368 @@
+/*
+ * ber_sweep.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Monte-Carlo BER and FER against Eb/N0
+ *
+ * Each Eb/N0 point runs trials of TRIAL_PACKETS packets, transmit,
+ * channel and receive, on every core. A trial draws its payloads,
+ * noise and fading from its own generator, seeded from the seed,
+ * the point and the trial number, so any trial can be repeated.
+ * A point stops once the bit errors reach the target, or at the
+ * packet limit, and is written as a CSV line:
+ *
+ *   ebn0_db,packets,detected,frame_errors,fer,bits,bit_errors,ber
+ *
+ * Packets not detected count as frame errors. The bits are those
+ * checked in the detected packets.
+ *
+ * The receiver keeps its state in qpsk.c, one per process, so the
+ * workers are forked processes sharing their counters through an
+ * anonymous shared mapping, rather than threads.
+ *
+ *   ber_sweep [-e start:stop:step] [-t errors] [-n packets] [-j jobs]
+ *             [-s seed] [-o file] [-f offset Hz] [-d drift Hz/s]
+ *             [-p ppm] [-w spread Hz] [-l delay ms]
+ *
+ * gcc -O2 -Iheaders bench/ber_sweep.c bench/bench.c src/[a-z]*.c -lm -lpthread
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "qpsk_internal.h"
+#include "scramble.h"
+#include "channel.h"
+#include "bench.h"
+
+// Defines
+
+#define DEFAULT_START       0.0
+#define DEFAULT_STOP        12.0
+#define DEFAULT_STEP        1.0
+#define DEFAULT_ERRORS      100
+#define DEFAULT_PACKETS     100000
+#define DEFAULT_SEED        1
+
+#define MAX_JOBS            256
+
+/*
+ * Packets sent through one channel instance
+ */
+#define TRIAL_PACKETS       8
+
+/*
+ * Silence after each trial, pushing the last
+ * packet out of the channel
+ */
+#define FLUSH_SIZE          (CHANNEL_HILBERT + CHANNEL_BLOCK)
+
+#define HISTORY             16
+#define CHANNEL_SIZE        (PACKET_SIZE * 2)
+#define STREAM_SIZE         (CHANNEL_SIZE + FRAME_SIZE)
+
+typedef struct {
+    int64_t peak;               // expected receiver sync, -1 for none
+    uint8_t bytes[BYTES_PER_FRAME];
+    bool detected;
+    int errors;
+} Packet;
+
+/*
+ * Totals for the current point, shared by the workers
+ */
+typedef struct {
+    atomic_long trial;          // next trial to run
+    atomic_long packets;
+    atomic_long detected;
+    atomic_long frame_errors;
+    atomic_long bits;
+    atomic_long bit_errors;
+} Totals;
+
+// Locals
+
+static ChannelConfig config = { .ebn0 = CHANNEL_CLEAN };
+static Totals *totals;
+
+static Channel sim;
+static Packet history[HISTORY];
+static int next_packet;
+
+static int16_t packet[PACKET_SIZE];
+static int16_t faded[CHANNEL_SIZE];
+static int16_t stream[STREAM_SIZE];
+static int fill;
+static int64_t received;
+
+// Functions
+
+/*
+ * splitmix64, spreads the trial numbers into seeds
+ */
+static uint64_t mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+
+    return x ^ (x >> 31);
+}
+
+/*
+ * Add a packet leaving the history to the totals
+ */
+static void retire(Packet *p) {
+    if (p->peak < 0)
+        return;
+
+    atomic_fetch_add(&totals->packets, 1);
+
+    if (p->detected == false || p->errors > 0)
+        atomic_fetch_add(&totals->frame_errors, 1);
+
+    p->peak = -1;
+}
+
+static void detect(int64_t sync, uint8_t ibytes[]) {
+    for (int i = 0; i < HISTORY; i++) {
+        Packet *p = &history[i];
+        int64_t delta = p->peak - sync;
+
+        if (p->peak >= 0 && p->detected == false && delta >= -CYCLES && delta <= CYCLES) {
+            scramble_bytes(ibytes, BYTES_PER_FRAME);
+
+            p->detected = true;
+            p->errors = bench_bit_errors(ibytes, p->bytes, CHECK_BITS);
+
+            atomic_fetch_add(&totals->detected, 1);
+            atomic_fetch_add(&totals->bits, CHECK_BITS);
+            atomic_fetch_add(&totals->bit_errors, p->errors);
+            return;
+        }
+    }
+}
+
+/*
+ * Append channel output to the stream and run the receiver
+ * over each complete frame
+ */
+static void receive(int16_t samples[], int length) {
+    uint8_t ibytes[BYTES_PER_FRAME];
+    int used = 0;
+
+    memcpy(&stream[fill], samples, sizeof (int16_t) * length);
+    fill += length;
+
+    while ((fill - used) >= FRAME_SIZE) {
+        if (qpsk_rx_frame(&stream[used], ibytes))
+            detect(received + qpsk_rx_sync(), ibytes);
+
+        used += FRAME_SIZE;
+        received += FRAME_SIZE;
+    }
+
+    memmove(stream, &stream[used], sizeof (int16_t) * (fill - used));
+    fill -= used;
+}
+
+/*
+ * One trial, TRIAL_PACKETS packets through a new channel
+ */
+static void trial(uint64_t seed) {
+    int64_t base = received + fill;     // channel output starts here
+    int64_t sent = 0;
+
+    channel_init(&sim, &config, seed);
+
+    for (int n = 0; n < TRIAL_PACKETS; n++) {
+        Packet *p = &history[next_packet];
+
+        next_packet = (next_packet + 1) % HISTORY;
+        retire(p);
+
+        for (int i = 0; i < BYTES_PER_FRAME; i++) {
+            p->bytes[i] = channel_random(&sim) & 0xFF;
+        }
+
+        int length = bench_packet(packet, p->bytes);
+
+        p->peak = base + bench_sync_peak(&sim, sent);
+        p->detected = false;
+        p->errors = 0;
+        sent += length;
+
+        receive(faded, channel_process(&sim, packet, length, faded));
+    }
+
+    memset(packet, 0, sizeof (int16_t) * FLUSH_SIZE);
+    receive(faded, channel_process(&sim, packet, FLUSH_SIZE, faded));
+}
+
+/*
+ * Runs trials until the point has its errors or packets
+ */
+static void worker(uint64_t seed, int point, long target, long limit) {
+    if (qpsk_create() == false) {
+        fprintf(stderr, "Unable to allocate modem memory\n");
+        _exit(2);
+    }
+
+    for (int i = 0; i < HISTORY; i++) {
+        history[i].peak = -1;
+    }
+
+    while (atomic_load(&totals->bit_errors) < target && atomic_load(&totals->packets) < limit) {
+        long t = atomic_fetch_add(&totals->trial, 1);
+
+        trial(mix(seed ^ mix(((uint64_t) point << 32) | (uint64_t) t)));
+    }
+
+    /*
+     * Two frames of silence for the receiver to finish the last packet
+     */
+    memset(faded, 0, sizeof (int16_t) * FRAME_SIZE);
+    receive(faded, FRAME_SIZE);
+    receive(faded, FRAME_SIZE);
+
+    for (int i = 0; i < HISTORY; i++) {
+        retire(&history[i]);
+    }
+
+    _exit(0);
+}
+
+int main(int argc, char **argv) {
+    double start = DEFAULT_START;
+    double stop = DEFAULT_STOP;
+    double step = DEFAULT_STEP;
+    long target = DEFAULT_ERRORS;
+    long limit = DEFAULT_PACKETS;
+    int jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t seed = DEFAULT_SEED;
+    FILE *out = stdout;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:t:n:j:s:o:f:d:p:w:l:")) != -1) {
+        switch (opt) {
+            case 'e':
+                if (sscanf(optarg, "%lf:%lf:%lf", &start, &stop, &step) < 2) {
+                    fprintf(stderr, "Bad Eb/N0 range %s\n", optarg);
+                    return 2;
+                }
+                break;
+            case 't':
+                target = atol(optarg);
+                break;
+            case 'n':
+                limit = atol(optarg);
+                break;
+            case 'j':
+                jobs = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'o':
+                if ((out = fopen(optarg, "w")) == NULL) {
+                    perror(optarg);
+                    return 2;
+                }
+                break;
+            case 'f':
+                config.offset = atof(optarg);
+                break;
+            case 'd':
+                config.drift = atof(optarg);
+                break;
+            case 'p':
+                config.ppm = atof(optarg);
+                break;
+            case 'w':
+                config.spread = atof(optarg);
+                break;
+            case 'l':
+                config.delay = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-e start:stop:step] [-t errors] [-n packets] [-j jobs]\n"
+                        "       [-s seed] [-o file] [-f offset Hz] [-d drift Hz/s]\n"
+                        "       [-p ppm] [-w spread Hz] [-l delay ms]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (step <= 0.0)
+        step = DEFAULT_STEP;
+
+    if (jobs < 1)
+        jobs = 1;
+    else if (jobs > MAX_JOBS)
+        jobs = MAX_JOBS;
+
+    totals = mmap(NULL, sizeof (Totals), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (totals == MAP_FAILED) {
+        perror("mmap");
+        return 2;
+    }
+
+    fprintf(out, "ebn0_db,packets,detected,frame_errors,fer,bits,bit_errors,ber\n");
+    fflush(out);
+
+    for (int point = 0; start + (point * step) <= stop + (step / 2.0); point++) {
+        config.ebn0 = start + (point * step);
+
+        atomic_store(&totals->trial, 0);
+        atomic_store(&totals->packets, 0);
+        atomic_store(&totals->detected, 0);
+        atomic_store(&totals->frame_errors, 0);
+        atomic_store(&totals->bits, 0);
+        atomic_store(&totals->bit_errors, 0);
+
+        for (int j = 0; j < jobs; j++) {
+            pid_t pid = fork();
+
+            if (pid == 0) {
+                worker(seed, point, target, limit);
+            } else if (pid < 0) {
+                perror("fork");
+                return 2;
+            }
+        }
+
+        int status;
+        bool failed = false;
+
+        while (wait(&status) > 0) {
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                failed = true;
+        }
+
+        if (failed) {
+            fprintf(stderr, "Worker failed at %.1f dB\n", config.ebn0);
+            return 2;
+        }
+
+        long packets = atomic_load(&totals->packets);
+        long bits = atomic_load(&totals->bits);
+        long errors = atomic_load(&totals->bit_errors);
+        long frame_errors = atomic_load(&totals->frame_errors);
+
+        fprintf(out, "%.2f,%ld,%ld,%ld,%.6f,%ld,%ld,%.6e\n", config.ebn0, packets,
+                atomic_load(&totals->detected), frame_errors,
+                (packets > 0) ? (double) frame_errors / (double) packets : 0.0,
+                bits, errors, (bits > 0) ? (double) errors / (double) bits : 0.0);
+        fflush(out);
+    }
+
+    if (out != stdout)
+        fclose(out);
+
+    return 0;
+}
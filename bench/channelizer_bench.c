@@ -0,0 +1,384 @@
+/*
+ * channelizer_bench.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Channelizer check, and example of a receiver on one channel
+ *
+ * A complex tone is put in each channel in turn, at an offset within
+ * it, and must come out of that channel at that offset, with every
+ * other channel at least CHECK_DB down. The program fails otherwise.
+ *
+ * Then the transmit audio of a few packets is moved to one channel
+ * of a wideband stream, with a tone in the next channel. The channel
+ * output is compared with the baseband of the transmit audio, then
+ * taken through channelizer_audio() into qpsk_rx_frame(), and the
+ * frames found listed beside those from the transmit audio fed to
+ * the receiver directly. The two paths frame the packets a few
+ * samples apart, so need not find the same frames.
+ *
+ *   channelizer_bench [-m channels] [-c channel]
+ *
+ * gcc -O2 -Iheaders bench/channelizer_bench.c bench/bench.c src/[a-z]*.c -lm -lpthread
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "qpsk_internal.h"
+#include "scramble.h"
+#include "channelizer.h"
+#include "fft.h"
+#include "bench.h"
+
+// Defines
+
+#define DEFAULT_CHANNELS    8
+#define DEFAULT_CHANNEL     2
+
+#define TONE_OFFSET         500.0f
+#define TONE_OUTPUTS        2048
+#define TONE_SETTLE         64
+
+#define CHECK_HZ            0.5f
+#define CHECK_DB            50.0f
+
+#define PACKETS             10
+
+/*
+ * Transmit audio length, a power of two over the
+ * packets for the FFT that moves it to a channel
+ */
+#define AUDIO_SIZE          32768
+
+#define INTERFERER          0.5f
+
+// Locals
+
+static Channelizer chan;
+static int16_t audio[AUDIO_SIZE];
+static int16_t channel_audio[AUDIO_SIZE];
+static complex float baseband[AUDIO_SIZE];
+
+// Functions
+
+/*
+ * Put a unit tone at freq Hz in the wideband input, channelize it,
+ * and return the power (dB) of each channel and the frequency (Hz)
+ * in channel expect. The channel outputs are in out[].
+ */
+static float tone(int channels, double freq, int expect, complex float *out[], float power[]) {
+    int length = TONE_OUTPUTS * channels;
+    complex float *wide = calloc(length, sizeof (complex float));
+    double rate = (double) channels * FS;
+
+    for (int i = 0; i < length; i++) {
+        double phase = fmod(TAU * freq * (double) i / rate, TAU);
+
+        wide[i] = (float) cos(phase) + (float) sin(phase) * I;
+    }
+
+    channelizer_create(&chan, channels);
+
+    int outputs = channelizer_process(&chan, wide, length, out);
+
+    for (int k = 0; k < channels; k++) {
+        double sum = 0.0;
+
+        for (int i = TONE_SETTLE; i < outputs; i++) {
+            sum += cnormf(out[k][i]);
+        }
+
+        power[k] = 10.0f * log10f((float) (sum / (outputs - TONE_SETTLE)) + 1e-30f);
+    }
+
+    complex float turn = 0.0f;
+
+    for (int i = TONE_SETTLE + 1; i < outputs; i++) {
+        turn += out[expect][i] * conjf(out[expect][i - 1]);
+    }
+
+    free(wide);
+
+    return cargf(turn) * FS / TAU;
+}
+
+/*
+ * Tone in each channel, returns the number of channels failing
+ */
+static int check_tones(int channels) {
+    complex float *out[channels];
+    float power[channels];
+    int failed = 0;
+
+    for (int k = 0; k < channels; k++) {
+        out[k] = calloc(TONE_OUTPUTS + 1, sizeof (complex float));
+    }
+
+    printf("%7s %10s %10s %10s %10s\n", "channel", "tone Hz", "found Hz", "power dB", "worst dB");
+
+    for (int k = 0; k < channels; k++) {
+        float offset = (k & 1) ? -TONE_OFFSET : TONE_OFFSET;
+        float found = tone(channels, ((double) k * FS) + offset, k, out, power);
+        float worst = -INFINITY;
+
+        for (int j = 0; j < channels; j++) {
+            if (j != k && power[j] > worst)
+                worst = power[j];
+        }
+
+        bool pass = (fabsf(found - offset) <= CHECK_HZ) && ((power[k] - worst) >= CHECK_DB);
+
+        printf("%7d %10.1f %10.2f %10.2f %10.2f %s\n", k, offset, found, power[k], worst,
+                pass ? "" : "FAIL");
+
+        if (pass == false)
+            failed++;
+    }
+
+    for (int k = 0; k < channels; k++) {
+        free(out[k]);
+    }
+
+    return failed;
+}
+
+/*
+ * Transmit audio of the packets, preamble, NS
+ * data blocks and a gap, returns the length
+ */
+static int transmit() {
+    uint8_t bytes[BYTES_PER_FRAME];
+    int length = 0;
+
+    qpsk_create();
+
+    for (int p = 0; p < PACKETS; p++) {
+        for (int i = 0; i < BYTES_PER_FRAME; i++) {
+            bytes[i] = (uint8_t) (rand() & 0xFF);
+        }
+
+        length += bench_packet(&audio[length], bytes);
+    }
+
+    return length;
+}
+
+/*
+ * Move the transmit audio to channel k of a wideband stream at
+ * (channels * FS), with a tone in channel k + 1
+ *
+ * The positive half of the audio spectrum is the analytic signal
+ * around CENTER. Zero padding it to channels times the length
+ * interpolates it to the wideband rate, and it is then mixed from
+ * CENTER to (k * FS). The stream is advanced by the channelizer
+ * delay, so channel output i lines up with baseband[i], the
+ * analytic signal mixed down from CENTER at FS.
+ */
+static complex float *wideband(int channels, int k) {
+    int length = AUDIO_SIZE * channels;
+    complex float *spectrum = calloc(AUDIO_SIZE, sizeof (complex float));
+    complex float *wide = calloc(length, sizeof (complex float));
+    fft_cfg forward = fft_alloc(AUDIO_SIZE, 0, NULL, NULL);
+    fft_cfg inverse = fft_alloc(AUDIO_SIZE, 1, NULL, NULL);
+    fft_cfg wide_inverse = fft_alloc(length, 1, NULL, NULL);
+    double rate = (double) channels * FS;
+
+    /*
+     * Output i is filtered around input (channels * i) + channels - 1
+     * less the prototype delay, in wideband samples
+     */
+    double advance = ((double) (channels * CHAN_PHASE_TAPS) - 1.0) / 2.0 - (double) (channels - 1);
+
+    for (int i = 0; i < AUDIO_SIZE; i++) {
+        spectrum[i] = (float) audio[i] / 16384.0f;
+    }
+
+    fft_inplace(forward, spectrum);
+
+    spectrum[0] /= (float) AUDIO_SIZE;
+
+    for (int i = 1; i < AUDIO_SIZE; i++) {
+        spectrum[i] *= (i < (AUDIO_SIZE / 2)) ? (2.0f / (float) AUDIO_SIZE) : 0.0f;
+    }
+
+    for (int i = 0; i < (AUDIO_SIZE / 2); i++) {
+        double phase = fmod(TAU * (double) i * advance / (double) length, TAU);
+
+        wide[i] = spectrum[i] * ((float) cos(phase) + (float) sin(phase) * I);
+    }
+
+    memcpy(baseband, spectrum, sizeof (complex float) * AUDIO_SIZE);
+    fft_inplace(inverse, baseband);
+
+    for (int i = 0; i < AUDIO_SIZE; i++) {
+        double phase = fmod(TAU * CENTER * (double) i / FS, TAU);
+
+        baseband[i] *= (float) cos(phase) - (float) sin(phase) * I;
+    }
+
+    fft_inplace(wide_inverse, wide);
+
+    for (int i = 0; i < length; i++) {
+        double shift = fmod(TAU * (((double) k * FS) - CENTER) * ((double) i + advance) / rate, TAU);
+        double other = fmod(TAU * ((double) (k + 1) * FS + TONE_OFFSET) * (double) i / rate, TAU);
+
+        wide[i] *= (float) cos(shift) + (float) sin(shift) * I;
+        wide[i] += INTERFERER * ((float) cos(other) + (float) sin(other) * I);
+    }
+
+    free(spectrum);
+    fft_free(forward);
+    fft_free(inverse);
+    fft_free(wide_inverse);
+
+    return wide;
+}
+
+/*
+ * SNR (dB) of the channel output against the baseband, after
+ * removing a constant gain and phase, the channel rotation
+ */
+static float channel_snr(complex float out[], int length) {
+    complex float cross = 0.0f;
+    double power = 0.0;
+    double error = 0.0;
+
+    for (int i = TONE_SETTLE; i < length - TONE_SETTLE; i++) {
+        cross += out[i] * conjf(baseband[i]);
+        power += cnormf(baseband[i]);
+    }
+
+    complex float gain = cross / (float) power;
+
+    for (int i = TONE_SETTLE; i < length - TONE_SETTLE; i++) {
+        error += cnormf(out[i] - (gain * baseband[i]));
+    }
+
+    return 10.0f * log10f((float) ((cnormf(gain) * power) / error));
+}
+
+/*
+ * Run the receiver over the audio, recording the
+ * frame number, sync and payload of each valid frame
+ */
+static int receive(int16_t samples[], int length, int found[], int sync[], uint8_t payload[][RX_BYTES]) {
+    uint8_t bytes[BYTES_PER_FRAME];
+    int count = 0;
+
+    qpsk_create();
+    scramble_init(rx);
+
+    for (int f = 0; (f + 1) * FRAME_SIZE <= length; f++) {
+        memset(bytes, 0, BYTES_PER_FRAME);
+
+        if (qpsk_rx_frame(&samples[f * FRAME_SIZE], bytes) == 1) {
+            scramble_bytes(bytes, RX_BYTES);
+            bytes[RX_BYTES - 1] &= (uint8_t) (0xFF >> ((8 - ((DATA_SYMBOLS * 2) % 8)) % 8));
+
+            found[count] = f;
+            sync[count] = qpsk_rx_sync();
+            memcpy(payload[count], bytes, RX_BYTES);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+int main(int argc, char **argv) {
+    int channels = DEFAULT_CHANNELS;
+    int channel = DEFAULT_CHANNEL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:c:")) != -1) {
+        switch (opt) {
+            case 'm':
+                channels = atoi(optarg);
+                break;
+            case 'c':
+                channel = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-m channels] [-c channel]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (channels < 2 || (channels & (channels - 1)) != 0 || channel < 0 || channel >= channels) {
+        fprintf(stderr, "Channels must be a power of two from 2, and channel 0 to channels - 1\n");
+        return 2;
+    }
+
+    srand(1);
+
+    int failed = check_tones(channels);
+
+    /*
+     * Receiver on one channel
+     */
+    int length = transmit();
+    complex float *wide = wideband(channels, channel);
+    complex float *out[channels];
+
+    for (int k = 0; k < channels; k++) {
+        out[k] = calloc(AUDIO_SIZE + 1, sizeof (complex float));
+    }
+
+    channelizer_create(&chan, channels);
+    channelizer_process(&chan, wide, AUDIO_SIZE * channels, out);
+
+    float snr = channel_snr(out[channel], length);
+
+    channelizer_audio(&chan, channel, out[channel], channel_audio, AUDIO_SIZE);
+
+    int direct_frame[PACKETS * 2], direct_sync[PACKETS * 2];
+    int chan_frame[PACKETS * 2], chan_sync[PACKETS * 2];
+    uint8_t direct_bytes[PACKETS * 2][RX_BYTES];
+    uint8_t chan_bytes[PACKETS * 2][RX_BYTES];
+
+    int direct = receive(audio, length, direct_frame, direct_sync, direct_bytes);
+    int channelized = receive(channel_audio, length, chan_frame, chan_sync, chan_bytes);
+
+    printf("\nchannel %d of %d, %d packets, tone in channel %d\n", channel, channels, PACKETS,
+            (channel + 1) % channels);
+    printf("channel output against the transmit baseband %.1f dB\n\n", snr);
+    printf("%-12s %6s %8s  %-16s\n", "path", "frame", "sync", "payload");
+
+    for (int i = 0; i < direct; i++) {
+        printf("%-12s %6d %8d  ", "direct", direct_frame[i], direct_sync[i]);
+
+        for (int b = 0; b < RX_BYTES; b++) {
+            printf("%02x", direct_bytes[i][b]);
+        }
+
+        printf("\n");
+    }
+
+    for (int i = 0; i < channelized; i++) {
+        printf("%-12s %6d %8d  ", "channelized", chan_frame[i], chan_sync[i]);
+
+        for (int b = 0; b < RX_BYTES; b++) {
+            printf("%02x", chan_bytes[i][b]);
+        }
+
+        printf("\n");
+    }
+
+    channelizer_destroy(&chan);
+
+    for (int k = 0; k < channels; k++) {
+        free(out[k]);
+    }
+
+    free(wide);
+
+    if (failed > 0) {
+        printf("\nFAIL: %d channels\n", failed);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,325 @@
+/*
+ * e2e_bench.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * End to end realtime factor benchmark
+ *
+ * Generates minutes of packets the same as the loopback test, a
+ * preamble, NS data blocks and a gap, passes them through the
+ * channel simulator, and runs the receiver over the result. The CPU time of
+ * each stage is measured, and the decoded payloads checked against
+ * what was sent.
+ *
+ * The realtime factor is the audio seconds received per CPU second
+ * of the receiver, so roughly the channels one core can carry.
+ *
+ *   e2e_bench [-m minutes] [-e EbN0 dB] [-s seed] [-f offset Hz]
+ *             [-d drift Hz/s] [-p ppm] [-w spread Hz] [-l delay ms]
+ *
+ * gcc -O2 -Iheaders bench/e2e_bench.c bench/bench.c src/[a-z]*.c -lm -lpthread
+ *
+ * Adding -DQPSK_PROFILE also lists the time of each receiver stage.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "qpsk_internal.h"
+#include "scramble.h"
+#include "channel.h"
+#include "profile.h"
+#include "bench.h"
+
+// Defines
+
+#define DEFAULT_MINUTES     1.0
+#define DEFAULT_SEED        1
+
+/*
+ * Packets remembered for matching to detections
+ */
+#define HISTORY             8
+
+/*
+ * Channel output for one packet, allowing for the clock skew
+ */
+#define CHANNEL_SIZE        (PACKET_SIZE * 2)
+
+#define STREAM_SIZE         (CHANNEL_SIZE + FRAME_SIZE)
+
+typedef enum {
+    stage_tx,
+    stage_channel,
+    stage_rx,
+    stage_check,
+    STAGES
+} Stage;
+
+typedef struct {
+    int64_t start;              // first sample of the packet
+    uint8_t bytes[BYTES_PER_FRAME];
+    bool decoded;
+} Packet;
+
+// Locals
+
+static const char *stage_names[STAGES] = { "tx", "channel", "rx", "check" };
+static double stage_ns[STAGES];
+
+static uint64_t rng_state;
+
+static Channel sim;
+
+static int16_t packet[PACKET_SIZE];
+static int16_t faded[CHANNEL_SIZE];
+static int16_t stream[STREAM_SIZE];
+static Packet history[HISTORY];
+
+// Functions
+
+static double cpu_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return ((double) ts.tv_sec * 1e9) + (double) ts.tv_nsec;
+}
+
+/*
+ * One packet with a new random payload, returns the samples
+ */
+static int tx_packet(uint8_t bytes[]) {
+    for (int i = 0; i < BYTES_PER_FRAME; i++) {
+        bytes[i] = channel_xorshift(&rng_state) & 0xFF;
+    }
+
+    return bench_packet(packet, bytes);
+}
+
+/*
+ * The packet expected within a symbol of the sync found
+ */
+static Packet *match(int64_t sync) {
+    for (int i = 0; i < HISTORY; i++) {
+        int64_t delta = bench_sync_peak(&sim, history[i].start) - sync;
+
+        if (history[i].start >= 0 && delta >= -CYCLES && delta <= CYCLES)
+            return &history[i];
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    double minutes = DEFAULT_MINUTES;
+    ChannelConfig config = { .ebn0 = CHANNEL_CLEAN };
+    uint64_t seed = DEFAULT_SEED;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:e:s:f:d:p:w:l:")) != -1) {
+        switch (opt) {
+            case 'm':
+                minutes = atof(optarg);
+                break;
+            case 'e':
+                config.ebn0 = atof(optarg);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'f':
+                config.offset = atof(optarg);
+                break;
+            case 'd':
+                config.drift = atof(optarg);
+                break;
+            case 'p':
+                config.ppm = atof(optarg);
+                break;
+            case 'w':
+                config.spread = atof(optarg);
+                break;
+            case 'l':
+                config.delay = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-m minutes] [-e EbN0 dB] [-s seed] [-f offset Hz]\n"
+                        "       [-d drift Hz/s] [-p ppm] [-w spread Hz] [-l delay ms]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    channel_init(&sim, &config, seed ^ 0x9E3779B97F4A7C15ULL);
+
+    if (channel_max_output(&sim, PACKET_SIZE) > CHANNEL_SIZE) {
+        fprintf(stderr, "Clock skew too large\n");
+        return 2;
+    }
+
+    rng_state = (seed == 0) ? 1 : seed;
+
+    if (qpsk_create() == false) {
+        fprintf(stderr, "Unable to allocate modem memory\n");
+        return 2;
+    }
+
+    for (int i = 0; i < HISTORY; i++) {
+        history[i].start = -1;
+    }
+
+    long packets = (long) ((minutes * 60.0 * FS) / PACKET_SIZE);
+    int64_t sent = 0;
+    int64_t received = 0;
+    int fill = 0;
+
+    long frames = 0;
+    long detected = 0;
+    long false_detects = 0;
+    long decoded = 0;
+    long errors = 0;
+    long bits = 0;
+    double snr = 0.0;
+    double evm = 0.0;
+
+    uint8_t ibytes[BYTES_PER_FRAME];
+
+    for (long p = 0; p < packets; p++) {
+        Packet *slot = &history[p % HISTORY];
+
+        if (slot->start >= 0 && slot->decoded == true)
+            decoded++;
+
+        double t0 = cpu_ns();
+
+        int length = tx_packet(slot->bytes);
+
+        slot->start = sent;
+        slot->decoded = false;
+        sent += length;
+
+        double t1 = cpu_ns();
+
+        int faded_length = channel_process(&sim, packet, length, faded);
+
+        double t2 = cpu_ns();
+
+        stage_ns[stage_tx] += t1 - t0;
+        stage_ns[stage_channel] += t2 - t1;
+
+        memcpy(&stream[fill], faded, sizeof (int16_t) * faded_length);
+        fill += faded_length;
+
+        int used = 0;
+
+        while ((fill - used) >= FRAME_SIZE) {
+            t0 = cpu_ns();
+
+            int valid = qpsk_rx_frame(&stream[used], ibytes);
+
+            t1 = cpu_ns();
+
+            stage_ns[stage_rx] += t1 - t0;
+
+            if (valid) {
+                Packet *found = match(received + qpsk_rx_sync());
+
+                FrameQuality quality;
+
+                qpsk_rx_quality(&quality);
+                snr += quality.snr;
+                evm += quality.evm;
+                detected++;
+
+                if (found == NULL) {
+                    false_detects++;
+                } else {
+                    scramble_bytes(ibytes, BYTES_PER_FRAME);
+
+                    int e = bench_bit_errors(ibytes, found->bytes, CHECK_BITS);
+
+                    errors += e;
+                    bits += CHECK_BITS;
+
+                    if (e == 0)
+                        found->decoded = true;
+                }
+
+                stage_ns[stage_check] += cpu_ns() - t1;
+            }
+
+            used += FRAME_SIZE;
+            received += FRAME_SIZE;
+            frames++;
+        }
+
+        memmove(stream, &stream[used], sizeof (int16_t) * (fill - used));
+        fill -= used;
+    }
+
+    for (int i = 0; i < HISTORY; i++) {
+        if (history[i].start >= 0 && history[i].decoded == true)
+            decoded++;
+    }
+
+    double audio = (double) received / FS;
+    double total = 0.0;
+
+    for (int i = 0; i < STAGES; i++) {
+        total += stage_ns[i];
+    }
+
+    printf("audio seconds     %.1f\n", audio);
+    printf("packets           %ld\n", packets);
+    printf("frames            %ld\n", frames);
+
+    if (config.ebn0 >= CHANNEL_CLEAN)
+        printf("Eb/N0 dB          clean\n");
+    else
+        printf("Eb/N0 dB          %.1f\n", config.ebn0);
+
+    printf("offset Hz         %.1f (drift %.2f Hz/s)\n", config.offset, config.drift);
+    printf("clock ppm         %.1f\n", config.ppm);
+
+    if (config.spread > 0.0f)
+        printf("fading            %.2f Hz spread, %.1f ms delay\n", config.spread, config.delay);
+    else
+        printf("fading            none\n");
+
+    printf("\n%-10s %12s %10s %12s\n", "stage", "cpu ms", "percent", "x realtime");
+
+    for (int i = 0; i < STAGES; i++) {
+        printf("%-10s %12.1f %9.1f%% %12.1f\n", stage_names[i], stage_ns[i] / 1e6,
+                (100.0 * stage_ns[i]) / total,
+                (stage_ns[i] > 0.0) ? (audio * 1e9) / stage_ns[i] : 0.0);
+    }
+
+    ProfileStats ps;
+
+    if (profile_stats(profile_convert, &ps) == true) {
+        printf("\n%-10s %12s %10s %10s %10s %10s\n", "rx stage", "frames", "mean ns", "p50 ns", "p99 ns", "max ns");
+
+        for (int i = 0; i < PROFILE_STAGES; i++) {
+            profile_stats(i, &ps);
+            printf("%-10s %12llu %10.0f %10.0f %10.0f %10.0f\n", ps.name, (unsigned long long) ps.count,
+                    ps.mean, ps.p50, ps.p99, ps.max);
+        }
+    }
+
+    printf("\nrealtime factor   %.1f (receive channels per core)\n",
+            (audio * 1e9) / stage_ns[stage_rx]);
+    printf("detections        %ld (%ld unmatched)\n", detected, false_detects);
+    printf("packets decoded   %ld of %ld, FER %.4f\n", decoded, packets,
+            1.0 - ((double) decoded / (double) packets));
+    printf("bit errors        %ld of %ld, BER %.2e\n", errors, bits,
+            (bits > 0) ? (double) errors / (double) bits : 0.0);
+
+    if (detected > 0)
+        printf("frame quality     SNR %.1f dB, EVM %.3f (mean of detections)\n",
+                snr / detected, evm / detected);
+
+    return 0;
+}
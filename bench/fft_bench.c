@@ -0,0 +1,248 @@
+/*
+ * fft_bench.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * FFT benchmark, the original scalar butterflies against the
+ * vector butterflies, the in-place radix 2, the split layout and
+ * batches through fft_many(), for power of two sizes 64 to 8192,
+ * forward and inverse.
+ *
+ * Each result is checked against fft(), and fft_many() also on
+ * mixed radix sizes. Exits with failure if any is out by more
+ * than CHECK_LIMIT of the peak.
+ *
+ * gcc -O2 -march=native -Iheaders bench/fft_bench.c src/fft.c src/arena.c -lm -lpthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "fft.h"
+
+// Defines
+
+#define MIN_SIZE        64
+#define MAX_SIZE        8192
+#define POINTS          4000000L
+#define BATCH           16
+#define CHECK_LIMIT     1e-5f
+
+// Locals
+
+static complex float input[MAX_SIZE];
+static complex float output[MAX_SIZE];
+static complex float reference[MAX_SIZE];
+static float input_re[MAX_SIZE];
+static float input_im[MAX_SIZE];
+static float split_re[MAX_SIZE];
+static float split_im[MAX_SIZE];
+static complex float batch[BATCH][MAX_SIZE];
+static complex float *signals[BATCH];
+static complex float work[FFT_MANY_WORK(MAX_SIZE)];
+
+/*
+ * Mixed radix sizes for the fft_many() check, 539 = 7 * 7 * 11
+ * takes the generic butterfly
+ */
+static const int mixed_sizes[] = { 12, 100, 539, 1000 };
+
+// Functions
+
+static double now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+/*
+ * Largest error against the reference, relative to its peak
+ */
+static float max_error(complex float a[], int n) {
+    float peak = 0.0f;
+    float error = 0.0f;
+
+    for (int i = 0; i < n; i++) {
+        if (cabsf(reference[i]) > peak)
+            peak = cabsf(reference[i]);
+
+        if (cabsf(a[i] - reference[i]) > error)
+            error = cabsf(a[i] - reference[i]);
+    }
+
+    return error / peak;
+}
+
+/*
+ * Nanoseconds per transform
+ * 0 = fft, 1 = fft_inplace, 2 = fft_split, 3 = fft_many
+ *
+ * The in-place modes reload the input each time, else the
+ * repeated transforms overflow and time the NaN path instead
+ */
+static double run(fft_cfg cfg, int mode, long repeat) {
+    int n = cfg->nfft;
+    double start = now();
+
+    for (long r = 0; r < repeat; r++) {
+        switch (mode) {
+            case 0:
+                fft(cfg, input, output);
+                break;
+            case 1:
+                memcpy(output, input, sizeof (complex float) * n);
+                fft_inplace(cfg, output);
+                break;
+            case 2:
+                memcpy(split_re, input_re, sizeof (float) * n);
+                memcpy(split_im, input_im, sizeof (float) * n);
+                fft_split(cfg, split_re, split_im);
+                break;
+            default:
+                for (int b = 0; b < BATCH; b++) {
+                    memcpy(signals[b], input, sizeof (complex float) * n);
+                }
+
+                fft_many(cfg, signals, BATCH, work);
+                r += BATCH - 1;
+        }
+    }
+
+    return ((now() - start) * 1e9) / repeat;
+}
+
+/*
+ * Largest error of fft_many() against fft(), each signal
+ * of the batch a different rotation of the input
+ */
+static float check_many(fft_cfg cfg) {
+    int n = cfg->nfft;
+    float error = 0.0f;
+
+    for (int b = 0; b < BATCH; b++) {
+        for (int i = 0; i < n; i++) {
+            batch[b][i] = input[(i + b) % n];
+        }
+    }
+
+    fft_many(cfg, signals, BATCH, work);
+
+    for (int b = 0; b < BATCH; b++) {
+        for (int i = 0; i < n; i++) {
+            output[i] = input[(i + b) % n];
+        }
+
+        fft(cfg, output, reference);
+
+        if (max_error(batch[b], n) > error)
+            error = max_error(batch[b], n);
+    }
+
+    return error;
+}
+
+int main(int argc, char **argv) {
+    float worst = 0.0f;
+
+    (void) argc;
+    (void) argv;
+
+    srand(1);
+
+    for (int b = 0; b < BATCH; b++) {
+        signals[b] = batch[b];
+    }
+
+    for (int i = 0; i < MAX_SIZE; i++) {
+        input[i] = ((float) rand() / RAND_MAX - 0.5f) + ((float) rand() / RAND_MAX - 0.5f) * I;
+        input_re[i] = crealf(input[i]);
+        input_im[i] = cimagf(input[i]);
+    }
+
+    printf("%5s %4s %10s %10s %10s %10s %10s %8s %10s\n",
+            "size", "dir", "scalar ns", "simd ns", "inplace ns", "split ns", "many ns", "speedup", "error");
+
+    for (int n = MIN_SIZE; n <= MAX_SIZE; n <<= 1) {
+        for (int inverse = 0; inverse < 2; inverse++) {
+            fft_cfg cfg = fft_alloc(n, inverse, NULL, NULL);
+            long repeat = POINTS / n;
+            float error = 0.0f;
+
+            /* warm up and check the results against the scalar code */
+
+            fft_set_simd(false);
+            fft(cfg, input, reference);
+
+            fft_set_simd(true);
+            fft(cfg, input, output);
+
+            if (max_error(output, n) > error)
+                error = max_error(output, n);
+
+            memcpy(output, input, sizeof (complex float) * n);
+            fft_inplace(cfg, output);
+
+            if (max_error(output, n) > error)
+                error = max_error(output, n);
+
+            memcpy(split_re, input_re, sizeof (float) * n);
+            memcpy(split_im, input_im, sizeof (float) * n);
+
+            fft_split(cfg, split_re, split_im);
+
+            for (int i = 0; i < n; i++) {
+                output[i] = split_re[i] + split_im[i] * I;
+            }
+
+            if (max_error(output, n) > error)
+                error = max_error(output, n);
+
+            if (check_many(cfg) > error)
+                error = check_many(cfg);
+
+            if (error > worst)
+                worst = error;
+
+            fft_set_simd(false);
+            double scalar = run(cfg, 0, repeat);
+
+            fft_set_simd(true);
+            double simd = run(cfg, 0, repeat);
+            double inplace = run(cfg, 1, repeat);
+            double split = run(cfg, 2, repeat);
+            double many = run(cfg, 3, repeat);
+
+            printf("%5d %4s %10.1f %10.1f %10.1f %10.1f %10.1f %7.2fx %10.2e\n",
+                    n, inverse ? "inv" : "fwd", scalar, simd, inplace, split, many, scalar / simd, error);
+
+            fft_free(cfg);
+        }
+    }
+
+    printf("\n%5s %4s %10s\n", "size", "dir", "many error");
+
+    for (size_t k = 0; k < sizeof (mixed_sizes) / sizeof (mixed_sizes[0]); k++) {
+        for (int inverse = 0; inverse < 2; inverse++) {
+            fft_cfg cfg = fft_alloc(mixed_sizes[k], inverse, NULL, NULL);
+            float error = check_many(cfg);
+
+            if (error > worst)
+                worst = error;
+
+            printf("%5d %4s %10.2e\n", mixed_sizes[k], inverse ? "inv" : "fwd", error);
+
+            fft_free(cfg);
+        }
+    }
+
+    if (worst > CHECK_LIMIT) {
+        printf("\nFAIL: error %.2e over %.0e\n", worst, CHECK_LIMIT);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,533 @@
+/*
+ * kernel_bench.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Microbenchmarks for the DSP kernels
+ *
+ * Every kernel runs on the same fixed seed input, is warmed up,
+ * then timed over a number of repeats. The median repeat is
+ * reported as JSON, one kernel per line:
+ *
+ *   kernel_bench [-s seed] [-w warmup] [-r repeats] > run.json
+ *
+ * Two runs are compared with:
+ *
+ *   kernel_bench -c old.json new.json [-t percent]
+ *
+ * which lists each kernel and exits 1 if any got slower by more
+ * than the threshold (default 5 percent).
+ *
+ * Before timing, the NCO is run over NCO_FRAMES frames and its
+ * worst phase error against the exact phase is reported with the
+ * output as nco_drift (radians). The run exits 1 if it is over
+ * NCO_DRIFT_LIMIT, or the mixer output leaves unit magnitude.
+ *
+ * gcc -O2 -Iheaders bench/kernel_bench.c src/[a-z]*.c -lm -lpthread
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+#include "qpsk_internal.h"
+#include "fir.h"
+#include "fft.h"
+#include "nco.h"
+#include "kalman.h"
+#include "scramble.h"
+#include "lutmod.h"
+#include "channel.h"
+
+// Defines
+
+#define DEFAULT_SEED        1
+#define DEFAULT_WARMUP      200
+#define DEFAULT_REPEATS     25
+#define DEFAULT_THRESHOLD   5.0
+
+#define MAX_REPEATS         1000
+#define MAX_KERNELS         32
+
+/*
+ * Each repeat runs for about this long
+ */
+#define REPEAT_NS           2000000.0
+
+#define BENCH_FFT_SIZE      512
+
+/*
+ * About a minute of receive, the float block phasors
+ * must not let the phase walk away from the exact one
+ */
+#define NCO_FRAMES          2000
+#define NCO_DRIFT_LIMIT     1e-6f
+#define NCO_MAGNITUDE_LIMIT 1e-6f
+
+typedef struct {
+    const char *name;
+    const char *unit;           // what one unit of work is
+    int units;                  // units per call
+    void (*run)(void);
+    void (*restore)(void);      // reloads the input of an in-place kernel, or NULL
+} Kernel;
+
+typedef struct {
+    char name[32];
+    double ns_per_unit;
+} Result;
+
+// Locals
+
+static uint64_t rng_state;
+
+static complex float fir_memory[NTAPS];
+static complex float fir_input[FRAME_SIZE];
+static complex float fir_samples[FRAME_SIZE];
+static complex float bandpass[NTAPS];
+static float real_samples[FRAME_SIZE + NTAPS];
+static complex float symbols[DECIMATED_SIZE * 2];
+static complex float baseband[FRAME_SIZE];
+static complex float fft_data[BENCH_FFT_SIZE];
+static uint8_t payload[BYTES_PER_FRAME];
+static uint8_t bits[BITS_PER_FRAME];
+static complex float modulated[DATA_SYMBOLS * CYCLESF];
+
+static fft_cfg bench_cfg;
+static NCO bench_nco;
+
+/*
+ * Keeps the results live, so the calls are not optimized away
+ */
+static volatile float sink;
+
+// Functions
+
+/*
+ * The channel xorshift64*, so the input is the same on every platform
+ */
+static uint64_t rng_next() {
+    return channel_xorshift(&rng_state);
+}
+
+static float rng_float() {
+    return ((float) (rng_next() >> 40) / (float) (1 << 24)) - 0.5f;
+}
+
+static double now_ns() {
+    return (double) qpsk_now_ns();
+}
+
+static uint64_t cycles() {
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Mix frames of ones, so each output is the phasor applied. Returns
+ * the worst phase error from nco_phase_error() at each frame, and
+ * in magnitude the worst error from unit magnitude. The first output
+ * of a frame must be the nco_phasor() from before it, or the
+ * magnitude error is set to one.
+ */
+static float nco_drift(float *magnitude) {
+    NCO nco;
+    float worst = 0.0f;
+
+    *magnitude = 0.0f;
+
+    nco_init(&nco, -CENTER, FS);
+
+    for (int f = 0; f < NCO_FRAMES; f++) {
+        float error = fabsf(nco_phase_error(&nco));
+        complex float phasor = nco_phasor(&nco);
+
+        if (error > worst)
+            worst = error;
+
+        for (int i = 0; i < FRAME_SIZE; i++) {
+            baseband[i] = 1.0f;
+        }
+
+        nco_mix(&nco, baseband, FRAME_SIZE);
+
+        if (baseband[0] != phasor)
+            *magnitude = 1.0f;
+
+        for (int i = 0; i < FRAME_SIZE; i++) {
+            float off = fabsf(cabsf(baseband[i]) - 1.0f);
+
+            if (off > *magnitude)
+                *magnitude = off;
+        }
+    }
+
+    return worst;
+}
+
+static void input_init(uint64_t seed) {
+    rng_state = (seed == 0) ? 1 : seed;
+
+    for (int i = 0; i < FRAME_SIZE; i++) {
+        fir_input[i] = rng_float() + rng_float() * I;
+        baseband[i] = rng_float() + rng_float() * I;
+    }
+
+    for (int i = 0; i < (FRAME_SIZE + NTAPS); i++) {
+        real_samples[i] = rng_float();
+    }
+
+    for (int i = 0; i < (DECIMATED_SIZE * 2); i++) {
+        symbols[i] = rng_float() + rng_float() * I;
+    }
+
+    for (int i = 0; i < BITS_PER_FRAME; i++) {
+        bits[i] = rng_next() & 1;
+    }
+
+    for (int i = 0; i < BYTES_PER_FRAME; i++) {
+        payload[i] = rng_next() & 0xFF;
+    }
+}
+
+// Kernels
+
+/*
+ * The in-place kernels would otherwise run on their own output, and
+ * the repeated filtering decays to denormals, so the input is
+ * reloaded before each call outside the timed region
+ */
+static void restore_fir() {
+    memcpy(fir_samples, fir_input, sizeof (complex float) * FRAME_SIZE);
+}
+
+static void restore_fft() {
+    memcpy(fft_data, symbols, sizeof (complex float) * BENCH_FFT_SIZE);
+}
+
+static void run_fir() {
+    fir(fir_memory, false, fir_samples, FRAME_SIZE);
+    sink = crealf(fir_samples[0]);
+}
+
+static void run_fir_real() {
+    complex float sum = 0.0f;
+
+    for (int i = 0; i < DECIMATED_SIZE; i++) {
+        sum += fir_real(bandpass, real_samples, (NTAPS - 1) + (i * CYCLES));
+    }
+
+    sink = crealf(sum);
+}
+
+static void run_correlate() {
+    float sum = 0.0f;
+
+    for (int i = 0; i < PREAMBLE_LENGTH; i++) {
+        sum += qpsk_correlate(symbols, i);
+    }
+
+    sink = sum;
+}
+
+static void run_kalman() {
+    for (int i = 0; i < DATA_SYMBOLS; i++) {
+        kalman_calculate(symbols, i);
+    }
+
+    sink = crealf(symbols[0]);
+}
+
+static void run_scramble() {
+    for (int i = 0; i < BITS_PER_FRAME; i += BITS) {
+        scramble(&bits[i], tx);
+    }
+
+    sink = bits[0];
+}
+
+static void run_scramble_bytes() {
+    scramble_bytes(payload, BYTES_PER_FRAME);
+    sink = payload[0];
+}
+
+static void run_fft() {
+    fft(bench_cfg, symbols, fft_data);
+    sink = crealf(fft_data[1]);
+}
+
+static void run_fft_inplace() {
+    fft_inplace(bench_cfg, fft_data);
+    sink = crealf(fft_data[1]);
+}
+
+static void run_nco() {
+    nco_mix(&bench_nco, baseband, FRAME_SIZE);
+    sink = crealf(baseband[0]);
+}
+
+static void run_lutmod() {
+    lutmod_modulate(modulated, payload, 0, DATA_SYMBOLS);
+    sink = crealf(modulated[0]);
+}
+
+static const Kernel kernels[] = {
+    { "fir", "sample", FRAME_SIZE, run_fir, restore_fir },
+    { "fir_real", "symbol", DECIMATED_SIZE, run_fir_real, NULL },
+    { "correlate", "offset", PREAMBLE_LENGTH, run_correlate, NULL },
+    { "kalman_calculate", "symbol", DATA_SYMBOLS, run_kalman, NULL },
+    { "scramble", "bit", BITS_PER_FRAME, run_scramble, NULL },
+    { "scramble_bytes", "bit", BITS_PER_FRAME, run_scramble_bytes, NULL },
+    { "fft_512", "sample", BENCH_FFT_SIZE, run_fft, NULL },
+    { "fft_inplace_512", "sample", BENCH_FFT_SIZE, run_fft_inplace, restore_fft },
+    { "nco_mix", "sample", FRAME_SIZE, run_nco, NULL },
+    { "lutmod_modulate", "symbol", DATA_SYMBOLS, run_lutmod, NULL }
+};
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Time of calls to the kernel, in ns and cycles. A kernel with a
+ * restore is timed call by call, so the reload is left out.
+ */
+static double timed_calls(const Kernel *k, long calls, double *cyc) {
+    if (k->restore == NULL) {
+        uint64_t c0 = cycles();
+        double t0 = now_ns();
+
+        for (long i = 0; i < calls; i++) {
+            k->run();
+        }
+
+        *cyc = (double) (cycles() - c0);
+
+        return now_ns() - t0;
+    }
+
+    double ns = 0.0;
+
+    *cyc = 0.0;
+
+    for (long i = 0; i < calls; i++) {
+        k->restore();
+
+        uint64_t c0 = cycles();
+        double t0 = now_ns();
+
+        k->run();
+
+        ns += now_ns() - t0;
+        *cyc += (double) (cycles() - c0);
+    }
+
+    return ns;
+}
+
+static void benchmark(const Kernel *k, int warmup, int repeats, bool last) {
+    static double ns[MAX_REPEATS];
+    static double cyc[MAX_REPEATS];
+    double c;
+
+    if (k->restore != NULL)
+        k->restore();
+
+    for (int i = 0; i < warmup; i++) {
+        k->run();
+
+        if (k->restore != NULL)
+            k->restore();
+    }
+
+    /*
+     * Calls per repeat, from a timed batch
+     */
+    double per_call = timed_calls(k, 16, &c) / 16.0;
+    long calls = (long) (REPEAT_NS / ((per_call > 1.0) ? per_call : 1.0));
+
+    if (calls < 1)
+        calls = 1;
+
+    for (int r = 0; r < repeats; r++) {
+        ns[r] = timed_calls(k, calls, &c) / (double) calls;
+        cyc[r] = c / (double) calls;
+    }
+
+    qsort(ns, repeats, sizeof (double), compare_double);
+    qsort(cyc, repeats, sizeof (double), compare_double);
+
+    double median = ns[repeats / 2];
+
+    printf("  {\"name\": \"%s\", \"unit\": \"%s\", \"units_per_op\": %d, "
+            "\"ns_per_op\": %.2f, \"ns_per_unit\": %.4f, \"min_ns_per_op\": %.2f, "
+            "\"cycles_per_op\": %.0f, \"units_per_sec\": %.0f}%s\n",
+            k->name, k->unit, k->units,
+            median, median / k->units, ns[0],
+            cyc[repeats / 2], (k->units * 1e9) / median,
+            last ? "" : ",");
+}
+
+/*
+ * Reads the name and ns_per_unit of each kernel line
+ */
+static int load_results(const char *filename, Result results[]) {
+    FILE *fp = fopen(filename, "r");
+    char line[512];
+    int count = 0;
+
+    if (fp == NULL) {
+        fprintf(stderr, "Unable to open %s\n", filename);
+        return -1;
+    }
+
+    while (fgets(line, sizeof (line), fp) != NULL && count < MAX_KERNELS) {
+        char *name = strstr(line, "\"name\": \"");
+        char *value = strstr(line, "\"ns_per_unit\": ");
+
+        if (name == NULL || value == NULL)
+            continue;
+
+        if (sscanf(name + 9, "%31[^\"]", results[count].name) == 1 &&
+                sscanf(value + 15, "%lf", &results[count].ns_per_unit) == 1) {
+            count++;
+        }
+    }
+
+    fclose(fp);
+
+    return count;
+}
+
+/*
+ * Returns 1 if any kernel is slower by more than threshold percent
+ */
+static int compare(const char *before, const char *after, double threshold) {
+    Result old[MAX_KERNELS];
+    Result new[MAX_KERNELS];
+    int regressions = 0;
+
+    int old_count = load_results(before, old);
+    int new_count = load_results(after, new);
+
+    if (old_count < 0 || new_count < 0)
+        return 2;
+
+    printf("%-20s %12s %12s %9s\n", "kernel", "before ns", "after ns", "change");
+
+    for (int i = 0; i < new_count; i++) {
+        for (int j = 0; j < old_count; j++) {
+            if (strcmp(new[i].name, old[j].name) != 0)
+                continue;
+
+            double change = ((new[i].ns_per_unit / old[j].ns_per_unit) - 1.0) * 100.0;
+            bool regressed = change > threshold;
+
+            printf("%-20s %12.4f %12.4f %+8.1f%%%s\n", new[i].name,
+                    old[j].ns_per_unit, new[i].ns_per_unit, change,
+                    regressed ? "  REGRESSION" : "");
+
+            if (regressed)
+                regressions++;
+        }
+    }
+
+    return (regressions > 0) ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    uint64_t seed = DEFAULT_SEED;
+    int warmup = DEFAULT_WARMUP;
+    int repeats = DEFAULT_REPEATS;
+    double threshold = DEFAULT_THRESHOLD;
+    bool comparing = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:w:r:t:c")) != -1) {
+        switch (opt) {
+            case 's':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'w':
+                warmup = atoi(optarg);
+                break;
+            case 'r':
+                repeats = atoi(optarg);
+                break;
+            case 't':
+                threshold = atof(optarg);
+                break;
+            case 'c':
+                comparing = true;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-s seed] [-w warmup] [-r repeats]\n"
+                        "       %s -c before.json after.json [-t percent]\n", argv[0], argv[0]);
+                return 2;
+        }
+    }
+
+    if (comparing == true) {
+        if ((argc - optind) != 2) {
+            fprintf(stderr, "compare needs two result files\n");
+            return 2;
+        }
+
+        return compare(argv[optind], argv[optind + 1], threshold);
+    }
+
+    if (repeats < 1)
+        repeats = 1;
+
+    if (repeats > MAX_REPEATS)
+        repeats = MAX_REPEATS;
+
+    if (qpsk_create() == false) {
+        fprintf(stderr, "Unable to allocate modem memory\n");
+        return 2;
+    }
+
+    float magnitude;
+    float drift = nco_drift(&magnitude);
+
+    input_init(seed);
+
+    fir_bandpass(bandpass, false, CENTER);
+    nco_init(&bench_nco, CENTER, FS);
+    bench_cfg = fft_alloc(BENCH_FFT_SIZE, 0, NULL, NULL);
+
+    int count = sizeof (kernels) / sizeof (kernels[0]);
+
+    printf("{\"seed\": %llu, \"warmup\": %d, \"repeats\": %d, "
+            "\"nco_drift\": %.3g, \"nco_magnitude\": %.3g, \"kernels\": [\n",
+            (unsigned long long) seed, warmup, repeats, drift, magnitude);
+
+    for (int i = 0; i < count; i++) {
+        benchmark(&kernels[i], warmup, repeats, i == (count - 1));
+        fflush(stdout);
+    }
+
+    printf("]}\n");
+
+    fft_free(bench_cfg);
+
+    if (drift > NCO_DRIFT_LIMIT || magnitude > NCO_MAGNITUDE_LIMIT) {
+        fprintf(stderr, "NCO drift %.3g radians, magnitude error %.3g\n", drift, magnitude);
+        return 1;
+    }
+
+    return 0;
+}
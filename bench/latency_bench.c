@@ -0,0 +1,235 @@
+/*
+ * latency_bench.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Sample to bits latency at realtime pace
+ *
+ * Packets are generated and passed through the channel simulator
+ * first, then handed to qpsk_rx_audio() a block at a time, each block
+ * as its last sample would arrive from a sound card. For every
+ * packet decoded the delay from the capture of its last data sample
+ * to the return of its payload is measured, and the distribution
+ * printed along with the receiver's own latency histograms.
+ *
+ *   latency_bench [-t seconds] [-b block samples] [-e EbN0 dB] [-s seed]
+ *                 [-x metrics file | unix:socket]
+ *
+ * With -x the receiver metrics are exported while it runs.
+ *
+ * gcc -O2 -Iheaders bench/latency_bench.c bench/bench.c src/[a-z]*.c -lm -lpthread
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "qpsk_internal.h"
+#include "channel.h"
+#include "histogram.h"
+#include "metrics.h"
+#include "bench.h"
+
+// Defines
+
+#define DEFAULT_SECONDS     20.0
+#define DEFAULT_BLOCK       160
+#define DEFAULT_SEED        1
+
+typedef struct {
+    int64_t peak;               // first preamble symbol in the stream
+    uint8_t bytes[BYTES_PER_FRAME];
+} Packet;
+
+// Locals
+
+static Channel sim;
+static int16_t packet[PACKET_SIZE];
+
+// Functions
+
+static void sleep_until(int64_t ns) {
+    struct timespec ts = { ns / 1000000000LL, ns % 1000000000LL };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+        ;
+}
+
+/*
+ * Build the whole stream through the channel, returns its length
+ */
+static int generate(int16_t stream[], int size, Packet packets[], int count) {
+    int length = 0;
+    int64_t sent = 0;
+
+    for (int p = 0; p < count; p++) {
+        for (int i = 0; i < BYTES_PER_FRAME; i++) {
+            packets[p].bytes[i] = channel_random(&sim) & 0xFF;
+        }
+
+        int n = bench_packet(packet, packets[p].bytes);
+
+        packets[p].peak = bench_sync_peak(&sim, sent);
+        sent += n;
+
+        if ((length + channel_max_output(&sim, n)) > size)
+            break;
+
+        length += channel_process(&sim, packet, n, &stream[length]);
+    }
+
+    return length;
+}
+
+static void print_stats(const char *name, LatencyStats *stats) {
+    printf("%-24s %8llu %10.3f %10.3f %10.3f %10.3f\n", name, (unsigned long long) stats->count,
+            stats->mean / 1e6, stats->p50 / 1e6, stats->p99 / 1e6, stats->max / 1e6);
+}
+
+int main(int argc, char **argv) {
+    double seconds = DEFAULT_SECONDS;
+    int block = DEFAULT_BLOCK;
+    ChannelConfig config = { .ebn0 = CHANNEL_CLEAN };
+    uint64_t seed = DEFAULT_SEED;
+    const char *metrics = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:b:e:s:x:")) != -1) {
+        switch (opt) {
+            case 't':
+                seconds = atof(optarg);
+                break;
+            case 'b':
+                block = atoi(optarg);
+                break;
+            case 'e':
+                config.ebn0 = atof(optarg);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'x':
+                metrics = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-t seconds] [-b block samples] [-e EbN0 dB] [-s seed]\n"
+                        "       [-x metrics file | unix:socket]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    /*
+     * At most one frame completes per block, so the
+     * sync found belongs to the last frame
+     */
+    if (block < 1 || block > FRAME_SIZE) {
+        fprintf(stderr, "Block must be 1 to %d samples\n", FRAME_SIZE);
+        return 2;
+    }
+
+    if (qpsk_create() == false) {
+        fprintf(stderr, "Unable to allocate modem memory\n");
+        return 2;
+    }
+
+    if (metrics != NULL && metrics_export_start(qpsk_metrics(), metrics, METRICS_PERIOD_MS) == false) {
+        fprintf(stderr, "Unable to export metrics to %s\n", metrics);
+        return 2;
+    }
+
+    channel_init(&sim, &config, seed);
+
+    int count = (int) ((seconds * FS) / PACKET_SIZE) + 1;
+    int size = (int) (seconds * FS) + PACKET_SIZE + CHANNEL_BLOCK;
+    Packet *packets = calloc(count, sizeof (Packet));
+    int16_t *stream = calloc(size, sizeof (int16_t));
+
+    if (packets == NULL || stream == NULL) {
+        fprintf(stderr, "Unable to allocate stream\n");
+        return 2;
+    }
+
+    int length = generate(stream, size, packets, count);
+
+    uint8_t ibytes[BYTES_PER_FRAME * 2];
+    Histogram measured;
+    long decoded = 0;
+    long unmatched = 0;
+    long late = 0;
+
+    histogram_reset(&measured);
+    qpsk_rx_latency_reset();
+
+    int64_t start = qpsk_now_ns();
+
+    for (int fed = 0; (fed + block) <= length; fed += block) {
+        int64_t due = start + (int64_t) (((double) (fed + block) * 1e9) / FS);
+
+        if (qpsk_now_ns() > due)
+            late++;
+
+        sleep_until(due);
+
+        if (qpsk_rx_audio(&stream[fed], block, ibytes) == 0)
+            continue;
+
+        int64_t frame = (((int64_t) (fed + block) / FRAME_SIZE) - 1) * FRAME_SIZE;
+        int64_t sync = frame + qpsk_rx_sync();
+        Packet *found = NULL;
+
+        for (int p = 0; p < count; p++) {
+            if (packets[p].peak >= sync - CYCLES && packets[p].peak <= sync + CYCLES) {
+                found = &packets[p];
+                break;
+            }
+        }
+
+        if (found == NULL) {
+            unmatched++;
+            continue;
+        }
+
+        RxTimes times;
+
+        qpsk_rx_times(&times);
+
+        /*
+         * Capture time of the center of the last data symbol returned
+         */
+        int64_t last = found->peak + ((PREAMBLE_LENGTH + DATA_SYMBOLS - 1) * CYCLES);
+        int64_t captured = start + (int64_t) (((double) last * 1e9) / FS);
+
+        histogram_add(&measured, (uint64_t) (times.emit - captured));
+        decoded++;
+    }
+
+    printf("audio seconds            %.1f\n", (double) length / FS);
+    printf("block samples            %d (%.1f ms)\n", block, (block * 1000.0) / FS);
+    printf("payloads                 %ld (%ld unmatched)\n", decoded, unmatched);
+    printf("blocks fed late          %ld\n", late);
+
+    printf("\n%-24s %8s %10s %10s %10s %10s\n", "latency ms", "frames", "mean", "p50", "p99", "max");
+
+    LatencyStats stats = {
+        measured.count, histogram_mean(&measured), histogram_percentile(&measured, 0.50),
+        histogram_percentile(&measured, 0.99), (double) measured.max
+    };
+
+    print_stats("sample to bits", &stats);
+
+    const char *names[LATENCY_KINDS] = { "rx arrival to sync", "rx arrival to emit", "rx bits (estimated)" };
+
+    for (int i = 0; i < LATENCY_KINDS; i++) {
+        qpsk_rx_latency(i, &stats);
+        print_stats(names[i], &stats);
+    }
+
+    metrics_export_stop();
+
+    free(stream);
+    free(packets);
+
+    return 0;
+}
@@ -0,0 +1,315 @@
+/*
+ * resample_bench.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Resampler check, at 48 kHz and 44.1 kHz, with and
+ * without sharing the root raised cosine filter
+ *
+ * A unit tone is swept over the stopband, and wherever it folds into
+ * the signal band at FS, CENTER +/- 1080 Hz, the level it leaves
+ * there must be CHECK_ALIAS_DB or lower.
+ *
+ * Then a few tones in the signal band are taken through
+ * qpsk_tx_audio() to the sound card rate and back to FS with the
+ * receive resampler, and must come back within CHECK_GAIN_DB with
+ * CHECK_SNR_DB over everything else. The program fails otherwise.
+ *
+ * Last the transmit audio of a few packets is taken the same way
+ * round, through qpsk_tx_audio() into qpsk_rx_audio(), and the
+ * frames found listed beside those from the transmit audio fed to
+ * the receiver directly.
+ *
+ *   resample_bench
+ *
+ * gcc -O2 -Iheaders bench/resample_bench.c bench/bench.c src/[a-z]*.c -lm -lpthread
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "qpsk_internal.h"
+#include "resample.h"
+#include "bench.h"
+
+// Defines
+
+/*
+ * The signal band at FS, either side of CENTER
+ */
+#define BAND_LOW            (CENTER - 1080.0f)
+#define BAND_HIGH           (CENTER + 1080.0f)
+
+#define SWEEP_STEP          10.0
+#define SWEEP_SECONDS       0.25
+#define SWEEP_SETTLE        500
+
+#define CHECK_ALIAS_DB      -70.0f
+#define CHECK_GAIN_DB       0.1f
+#define CHECK_SNR_DB        60.0f
+
+/*
+ * Round trip tones, whole cycles in the one second measured
+ */
+#define TONES               4
+#define TONE_AMPLITUDE      4000.0f
+#define TRIP_SETTLE         1000
+#define TRIP_LENGTH         ((int) FS)
+
+#define PACKETS             10
+#define AUDIO_SIZE          (PACKETS * PACKET_SIZE)
+
+// Locals
+
+static const int rates[] = { 48000, 44100 };
+static const float tone_freq[TONES] = { 300.0f, 900.0f, 1500.0f, 2100.0f };
+
+static int16_t audio[AUDIO_SIZE];
+
+// Functions
+
+/*
+ * Amplitude of the tone at freq Hz in samples at FS, removing it
+ */
+static float tone_remove(float samples[], int length, float freq) {
+    double re = 0.0;
+    double im = 0.0;
+
+    for (int i = 0; i < length; i++) {
+        double phase = fmod(TAU * freq * (double) i / FS, TAU);
+
+        re += samples[i] * cos(phase);
+        im += samples[i] * sin(phase);
+    }
+
+    re *= 2.0 / length;
+    im *= 2.0 / length;
+
+    for (int i = 0; i < length; i++) {
+        double phase = fmod(TAU * freq * (double) i / FS, TAU);
+
+        samples[i] -= (float) ((re * cos(phase)) + (im * sin(phase)));
+    }
+
+    return (float) sqrt((re * re) + (im * im));
+}
+
+/*
+ * Level (dB) left at fold Hz at FS by a unit tone at freq Hz at the rate
+ */
+static float alias_level(Resampler *r, int rate, double freq, float fold) {
+    int length = (int) (rate * SWEEP_SECONDS);
+    float *in = calloc(length, sizeof (float));
+    float *out = calloc(resample_max_output(r, length), sizeof (float));
+
+    for (int i = 0; i < length; i++) {
+        in[i] = (float) sin(fmod(TAU * freq * (double) i / rate, TAU));
+    }
+
+    resample_reset(r);
+
+    int outputs = resample_process(r, in, length, out);
+    float amplitude = tone_remove(&out[SWEEP_SETTLE], outputs - SWEEP_SETTLE, fold);
+
+    free(in);
+    free(out);
+
+    return 20.0f * log10f(amplitude + 1e-20f);
+}
+
+/*
+ * Sweep the stopband, returns true if the worst alias is low enough
+ */
+static bool check_alias(int rate, bool shared) {
+    Resampler r = { 0 };
+    float worst = -INFINITY;
+    float worst_freq = 0.0f;
+    float worst_fold = 0.0f;
+
+    resample_init(&r, rate, (int) FS, shared);
+
+    for (double freq = FS - BAND_HIGH; freq < (rate / 2.0); freq += SWEEP_STEP) {
+        float fold = (float) fmod(freq, FS);
+
+        if (fold > (FS / 2.0f)) {
+            fold = FS - fold;
+        }
+
+        if (fold < BAND_LOW || fold > BAND_HIGH) {
+            continue;
+        }
+
+        float level = alias_level(&r, rate, freq, fold);
+
+        if (level > worst) {
+            worst = level;
+            worst_freq = (float) freq;
+            worst_fold = fold;
+        }
+    }
+
+    resample_free(&r);
+
+    bool pass = (worst <= CHECK_ALIAS_DB);
+
+    printf("%6d %-7s %8s %10.0f %10.0f %10.1f %s\n", rate, shared ? "shared" : "normal", "alias",
+            worst_freq, worst_fold, worst, pass ? "" : "FAIL");
+
+    return pass;
+}
+
+/*
+ * Tones through qpsk_tx_audio() and back, returns true if they keep
+ * their level and the rest is low enough
+ */
+static bool check_round_trip(int rate, bool shared) {
+    int length = TRIP_SETTLE + TRIP_LENGTH;
+    int16_t *in = calloc(length, sizeof (int16_t));
+    int16_t *card = calloc(((int64_t) length * rate / (int) FS) + 1, sizeof (int16_t));
+    float *wide = calloc(((int64_t) length * rate / (int) FS) + 1, sizeof (float));
+    Resampler r = { 0 };
+
+    for (int i = 0; i < length; i++) {
+        float sum = 0.0f;
+
+        for (int k = 0; k < TONES; k++) {
+            sum += TONE_AMPLITUDE * (float) sin(fmod(TAU * tone_freq[k] * (double) i / FS, TAU));
+        }
+
+        in[i] = (int16_t) lrintf(sum);
+    }
+
+    qpsk_audio_rates((int) FS, rate, shared);
+    resample_init(&r, rate, (int) FS, shared);
+
+    int card_length = qpsk_tx_audio(card, in, length);
+
+    for (int i = 0; i < card_length; i++) {
+        wide[i] = (float) card[i];
+    }
+
+    float *out = calloc(resample_max_output(&r, card_length), sizeof (float));
+    int outputs = resample_process(&r, wide, card_length, out);
+    float *measured = &out[outputs - TRIP_LENGTH];
+    float gain = 0.0f;
+    double signal = 0.0;
+    double rest = 0.0;
+
+    for (int k = 0; k < TONES; k++) {
+        float amplitude = tone_remove(measured, TRIP_LENGTH, tone_freq[k]);
+        float db = 20.0f * log10f(amplitude / TONE_AMPLITUDE);
+
+        if (fabsf(db) > fabsf(gain)) {
+            gain = db;
+        }
+
+        signal += amplitude * amplitude / 2.0f;
+    }
+
+    for (int i = 0; i < TRIP_LENGTH; i++) {
+        rest += measured[i] * measured[i];
+    }
+
+    float snr = 10.0f * log10f((float) (signal / (rest / TRIP_LENGTH)));
+    bool pass = (fabsf(gain) <= CHECK_GAIN_DB) && (snr >= CHECK_SNR_DB);
+
+    printf("%6d %-7s %8s %10.2f %10s %10.1f %s\n", rate, shared ? "shared" : "normal", "trip",
+            gain, "", snr, pass ? "" : "FAIL");
+
+    resample_free(&r);
+    free(in);
+    free(card);
+    free(wide);
+    free(out);
+
+    return pass;
+}
+
+/*
+ * Transmit audio of the packets, preamble, NS
+ * data blocks and a gap, returns the length
+ */
+static int transmit() {
+    uint8_t bytes[BYTES_PER_FRAME];
+    int length = 0;
+
+    qpsk_create();
+
+    for (int p = 0; p < PACKETS; p++) {
+        for (int i = 0; i < BYTES_PER_FRAME; i++) {
+            bytes[i] = (uint8_t) (rand() & 0xFF);
+        }
+
+        length += bench_packet(&audio[length], bytes);
+    }
+
+    return length;
+}
+
+/*
+ * The packets through qpsk_tx_audio() at the rate and
+ * into qpsk_rx_audio(), returns the frames found
+ */
+static int receive(int length, int rate, bool shared) {
+    int16_t *card = calloc(((int64_t) length * rate / (int) FS) + 1, sizeof (int16_t));
+    uint8_t *bytes = calloc((length / FRAME_SIZE) + 1, BYTES_PER_FRAME);
+
+    qpsk_create();
+    qpsk_audio_rates(rate, rate, shared);
+
+    int card_length = qpsk_tx_audio(card, audio, length);
+    int frames = qpsk_rx_audio(card, card_length, bytes);
+
+    free(card);
+    free(bytes);
+
+    return frames;
+}
+
+int main() {
+    int failed = 0;
+
+    srand(1);
+
+    printf("%6s %-7s %8s %10s %10s %10s\n", "rate", "filter", "check", "tone Hz", "at FS Hz", "worst dB");
+
+    for (int k = 0; k < 2; k++) {
+        for (int s = 0; s < 2; s++) {
+            if (check_alias(rates[k], (s == 1)) == false)
+                failed++;
+        }
+    }
+
+    printf("\n%6s %-7s %8s %10s %10s %10s\n", "rate", "filter", "check", "gain dB", "", "SNR dB");
+
+    for (int k = 0; k < 2; k++) {
+        for (int s = 0; s < 2; s++) {
+            if (check_round_trip(rates[k], (s == 1)) == false)
+                failed++;
+        }
+    }
+
+    int length = transmit();
+
+    qpsk_audio_rates((int) FS, (int) FS, false);
+
+    int direct = receive(length, (int) FS, false);
+
+    printf("\n%d packets, frames found\n\n%-16s %6d\n", PACKETS, "direct", direct);
+
+    for (int k = 0; k < 2; k++) {
+        for (int s = 0; s < 2; s++) {
+            printf("%6d %-9s %6d\n", rates[k], (s == 1) ? "shared" : "normal", receive(length, rates[k], (s == 1)));
+        }
+    }
+
+    qpsk_audio_rates((int) FS, (int) FS, false);
+
+    if (failed > 0) {
+        printf("\nFAIL: %d checks\n", failed);
+        return 1;
+    }
+
+    return 0;
+}
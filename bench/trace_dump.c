@@ -0,0 +1,140 @@
+/*
+ * trace_dump.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Prints a receiver trace file written by trace.c
+ *
+ *   trace_dump [-t type] file     one record per line
+ *   trace_dump -s file            constellation, "re im" per symbol
+ *   trace_dump -d file            one line per preamble detected
+ *
+ * The -s output is the old TEST_SCATTER format for gnuplot, and -d
+ * the old DEBUG2 "Frames:" lines.
+ *
+ * gcc -O2 -Iheaders bench/trace_dump.c -o trace_dump
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "qpsk_internal.h"
+#include "trace.h"
+
+// Defines
+
+typedef enum {
+    dump_records,
+    dump_scatter,
+    dump_detections
+} DumpMode;
+
+// Locals
+
+static const char *type_names[] = {
+    "", "symbol", "peak", "match", "sync", "eq", "dropped"
+};
+
+#define TYPES   (int) (sizeof (type_names) / sizeof (type_names[0]))
+
+// Functions
+
+static int type_from_name(const char *name) {
+    for (int i = 1; i < TYPES; i++) {
+        if (strcmp(name, type_names[i]) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    DumpMode mode = dump_records;
+    int only = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:sd")) != -1) {
+        switch (opt) {
+            case 't':
+                if ((only = type_from_name(optarg)) < 0) {
+                    fprintf(stderr, "Unknown record type %s\n", optarg);
+                    return 2;
+                }
+                break;
+            case 's':
+                mode = dump_scatter;
+                break;
+            case 'd':
+                mode = dump_detections;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-t type | -s | -d] file\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-t type | -s | -d] file\n", argv[0]);
+        return 2;
+    }
+
+    FILE *in = fopen(argv[optind], "rb");
+
+    if (in == NULL) {
+        perror(argv[optind]);
+        return 2;
+    }
+
+    char magic[sizeof (TRACE_MAGIC)] = { 0 };
+    uint32_t size = 0;
+
+    if (fread(magic, 1, strlen(TRACE_MAGIC), in) != strlen(TRACE_MAGIC) ||
+            strcmp(magic, TRACE_MAGIC) != 0 ||
+            fread(&size, sizeof (uint32_t), 1, in) != 1 || size != sizeof (TraceRecord)) {
+        fprintf(stderr, "%s is not a trace file\n", argv[optind]);
+        fclose(in);
+        return 2;
+    }
+
+    TraceRecord record;
+    TraceRecord peak = { 0 };
+    TraceRecord match = { 0 };
+
+    while (fread(&record, sizeof (TraceRecord), 1, in) == 1) {
+        if (record.type == trace_dropped) {
+            fprintf(stderr, "%u records dropped\n", record.frame);
+            continue;
+        }
+
+        switch (mode) {
+            case dump_records:
+                if (only != 0 && record.type != only)
+                    break;
+
+                printf("%8u %-7s %5u %14.4f %14.4f\n", record.frame,
+                        (record.type < TYPES) ? type_names[record.type] : "?",
+                        record.index, record.a, record.b);
+                break;
+            case dump_scatter:
+                if (record.type == trace_symbol)
+                    printf("%f %f\n", record.a, record.b);
+                break;
+            case dump_detections:
+                if (record.type == trace_peak) {
+                    peak = record;
+                } else if (record.type == trace_match) {
+                    match = record;
+                } else if (record.type == trace_sync && peak.frame == record.frame && match.frame == record.frame) {
+                    printf("Frames: %u Matches: %u MaxIdx: %u MaxVal: %.2f Mean: %.2f\n",
+                            record.frame, match.index, peak.index, peak.a, peak.b);
+                }
+                break;
+        }
+    }
+
+    fclose(in);
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+/*
+ * acquire.h
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qpsk_internal.h"
+
+// Defines
+
+/*
+ * Symbols searched, one frame at the symbol rate
+ */
+#define ACQ_SYMBOLS     DECIMATED_SIZE
+
+/*
+ * Zero padded FFT length, the fourth power tone is at
+ * four times the offset, so the bin size is RS / (4 * ACQ_FFT_SIZE)
+ */
+#define ACQ_FFT_SIZE    512
+
+/*
+ * Offset of one bin (Hz), the interpolated estimate
+ * is well within this
+ */
+#define ACQ_BIN         (RS / (4.0f * ACQ_FFT_SIZE))
+
+/*
+ * Frequency offset lock range (+/- Hz)
+ */
+#define ACQ_RANGE       100.0f
+
+/*
+ * Peak to mean power ratio to declare a preamble tone
+ */
+#define ACQ_THRESHOLD   30.0f
+
+/*
+ * Frames an acquired offset is kept waiting for the preamble
+ * sync, the preamble tone is in the window for two frames
+ */
+#define ACQ_HOLD        2
+
+// Prototypes
+
+size_t acquire_memory(void);
+bool acquire_init(void);
+bool acquire_offset(complex float [], int, float *);
+void acquire_derotate(complex float [], int, float, float);
+
+#ifdef __cplusplus
+}
+#endif
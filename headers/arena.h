@@ -0,0 +1,39 @@
+/*
+ * arena.h
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qpsk_internal.h"
+
+// Defines
+
+#define ARENA_ALIGN     16
+
+// Prototypes
+
+bool arena_create(size_t);
+void arena_destroy(void);
+void *arena_alloc(size_t);
+size_t arena_used(void);
+bool arena_ready(void);
+bool arena_owns(const void *);
+
+void *qpsk_malloc(size_t);
+void qpsk_free(void *);
+
+#ifdef ALLOC_CHECK
+void alloc_check_begin(void);
+int alloc_check_end(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
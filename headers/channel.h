@@ -0,0 +1,97 @@
+/*
+ * channel.h
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qpsk_internal.h"
+#include "nco.h"
+
+// Defines
+
+/*
+ * Mean square of the transmit data samples, the
+ * default signal power for setting the noise
+ */
+#define CHANNEL_POWER       (7205.0f * 7205.0f)
+
+/*
+ * Eb/N0 (dB) at or above which no noise is added
+ */
+#define CHANNEL_CLEAN       100.0f
+
+/*
+ * Hilbert transformer taps, for the real to analytic signal
+ */
+#define CHANNEL_HILBERT     127
+
+/*
+ * Samples per block, the fading gains and drifting
+ * frequency are updated once per block
+ */
+#define CHANNEL_BLOCK       64
+
+/*
+ * Longest second path delay, 10 ms
+ */
+#define CHANNEL_MAX_DELAY   80
+
+/*
+ * Sinusoids summed for each fading path
+ */
+#define CHANNEL_SINUSOIDS   16
+
+typedef struct {
+    float ebn0;                 // dB, CHANNEL_CLEAN for none
+    float power;                // signal mean square, 0 for CHANNEL_POWER
+    float offset;               // carrier offset (Hz)
+    float drift;                // carrier drift (Hz per second)
+    float ppm;                  // sample clock skew (parts per million)
+    float spread;               // Watterson Doppler spread (Hz), 0 for no fading
+    float delay;                // Watterson second path delay (ms)
+} ChannelConfig;
+
+typedef struct {
+    ChannelConfig config;
+    uint64_t rng;               // xorshift64* state
+    float sigma;                // noise standard deviation
+    double time;                // seconds since init
+    NCO nco;
+
+    float hilbert[CHANNEL_HILBERT];             // coefficients
+    float history[CHANNEL_HILBERT + CHANNEL_BLOCK];
+
+    int delay;                                  // second path (samples)
+    complex float paths[CHANNEL_MAX_DELAY + CHANNEL_BLOCK];
+
+    float doppler[2][CHANNEL_SINUSOIDS];        // fading frequencies (Hz)
+    float phases[2][CHANNEL_SINUSOIDS];         // fading phases (radians)
+    complex float gain[2];                      // path gains at block start
+
+    double skew_position;       // fractional input position
+    double skew_step;           // input samples per output
+    float skew_history[4];
+
+    float pending[CHANNEL_BLOCK];
+    int pending_count;
+} Channel;
+
+// Prototypes
+
+void channel_init(Channel *, const ChannelConfig *, uint64_t);
+int channel_process(Channel *, const int16_t [], int, int16_t []);
+int channel_max_output(Channel *, int);
+uint64_t channel_xorshift(uint64_t *);
+uint64_t channel_random(Channel *);
+float channel_gauss(Channel *);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,52 @@
+/*
+ * channelizer.h
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qpsk_internal.h"
+#include "fft.h"
+#include "nco.h"
+
+// Defines
+
+/*
+ * Prototype filter taps for each polyphase branch
+ */
+#define CHAN_PHASE_TAPS     16
+
+/*
+ * Input buffer length, in outputs, between history copies
+ */
+#define CHAN_BUFFER_BLOCKS  64
+
+typedef struct {
+    int channels;               // M, the input rate is (M * FS)
+    int taps;                   // prototype length
+    int length;                 // buffer length
+    int write;                  // newest sample position plus one
+    int count;                  // samples since the last output
+    float *prototype;           // lowpass, taps
+    complex float *buffer;      // input history
+    complex float *branch;      // branch outputs, M
+    NCO *nco;                   // per channel, for channelizer_audio()
+    fft_cfg cfg;                // M point inverse
+} Channelizer;
+
+// Prototypes
+
+bool channelizer_create(Channelizer *, int);
+void channelizer_destroy(Channelizer *);
+int channelizer_process(Channelizer *, complex float [], int, complex float *[]);
+void channelizer_audio(Channelizer *, int, complex float [], int16_t [], int);
+
+#ifdef __cplusplus
+}
+#endif
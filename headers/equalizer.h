@@ -14,8 +14,20 @@ extern "C"
 
 #include "qpsk_internal.h"
 
+// Defines
+
+/*
+ * Weight of each frame in the running
+ * average of the error power
+ */
+#define EQ_QUALITY_WEIGHT   0.1f
+
+// Prototypes
+
 float train_eq(complex float [], int, float);
-float data_eq(uint8_t *, complex float [], int);
+float data_eq(uint8_t [], int, complex float [], int);
+void eq_frame(FrameQuality *);
+void eq_quality_reset(void);
 
 #ifdef __cplusplus
 }
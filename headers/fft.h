@@ -25,7 +25,10 @@ struct fft_state {
     int nfft;
     int inverse;
     int factors[64];
-    complex float twiddles[1];
+    complex float *tmpbuf;      /* in-place output, nfft */
+    complex float *scratch;     /* generic radix butterfly */
+    int *bitrev;                /* in-place permutation, power of two only */
+    complex float *twiddles;    /* nfft, shared by the plans of a size */
 };
 
 typedef struct fft_state *fft_cfg;
@@ -43,7 +46,29 @@ typedef struct fftr_state *fftr_cfg;
 /* Complex Function Calls */
 
 fft_cfg fft_alloc(int, int, void *, size_t *);
+void fft_free(void *);
 void fft(fft_cfg, const complex float *, complex float *);
+void fft_inplace(fft_cfg, complex float *);
+bool fft_split(fft_cfg, float [], float []);
+void fft_set_simd(bool);
+
+/* Batched Transforms */
+
+/*
+ * Work buffer length in complex floats for fft_many()
+ * on nfft points, enough for the widest vector
+ */
+#define FFT_MANY_WORK(nfft) ((nfft) * 4)
+
+void fft_many(fft_cfg, complex float *[], int, complex float []);
+
+/* Plan Cache */
+
+#define FFT_PLANS 16
+
+fft_cfg fft_plan(int, int);
+void fft_plan_free(fft_cfg);
+size_t fft_plan_memory(int);
 
 /* Real Function Calls */
 
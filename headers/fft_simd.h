@@ -0,0 +1,182 @@
+/*
+ * fft_simd.h
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Vector helpers for the FFT butterflies, FFT_VLEN complex
+ * floats at a time, interleaved [re, im, re, im, ...]
+ *
+ * AVX (4 complex), SSE3 (2 complex), or AArch64 NEON (2 complex)
+ * as enabled by the compiler flags, otherwise FFT_VLEN is 0 and
+ * only the scalar butterflies are built.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <complex.h>
+#include <stddef.h>
+
+#if defined(__AVX__)
+
+#include <immintrin.h>
+
+#define FFT_VLEN 4
+
+typedef __m256 fft_vec;
+
+static inline fft_vec v_load(const complex float *p) {
+    return _mm256_loadu_ps((const float *) p);
+}
+
+static inline void v_store(complex float *p, fft_vec a) {
+    _mm256_storeu_ps((float *) p, a);
+}
+
+static inline fft_vec v_add(fft_vec a, fft_vec b) {
+    return _mm256_add_ps(a, b);
+}
+
+static inline fft_vec v_sub(fft_vec a, fft_vec b) {
+    return _mm256_sub_ps(a, b);
+}
+
+static inline fft_vec v_cmul(fft_vec a, fft_vec b) {
+    fft_vec re = _mm256_moveldup_ps(b);
+    fft_vec im = _mm256_movehdup_ps(b);
+    fft_vec swap = _mm256_permute_ps(a, 0xB1);
+
+    return _mm256_addsub_ps(_mm256_mul_ps(a, re), _mm256_mul_ps(swap, im));
+}
+
+/* j * a */
+static inline fft_vec v_mulj(fft_vec a) {
+    fft_vec swap = _mm256_permute_ps(a, 0xB1);
+
+    return _mm256_xor_ps(swap, _mm256_set_ps(0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f));
+}
+
+/* *p in every lane */
+static inline fft_vec v_splat(const complex float *p) {
+    return _mm256_castpd_ps(_mm256_broadcast_sd((const double *) p));
+}
+
+/* p[0], p[stride], p[2 * stride], p[3 * stride] */
+static inline fft_vec v_gather(const complex float *p, size_t stride) {
+    __m128 lo = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *) p);
+    __m128 hi = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *) (p + (2 * stride)));
+
+    lo = _mm_loadh_pi(lo, (const __m64 *) (p + stride));
+    hi = _mm_loadh_pi(hi, (const __m64 *) (p + (3 * stride)));
+
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+#elif defined(__SSE3__)
+
+#include <pmmintrin.h>
+
+#define FFT_VLEN 2
+
+typedef __m128 fft_vec;
+
+static inline fft_vec v_load(const complex float *p) {
+    return _mm_loadu_ps((const float *) p);
+}
+
+static inline void v_store(complex float *p, fft_vec a) {
+    _mm_storeu_ps((float *) p, a);
+}
+
+static inline fft_vec v_add(fft_vec a, fft_vec b) {
+    return _mm_add_ps(a, b);
+}
+
+static inline fft_vec v_sub(fft_vec a, fft_vec b) {
+    return _mm_sub_ps(a, b);
+}
+
+static inline fft_vec v_cmul(fft_vec a, fft_vec b) {
+    fft_vec re = _mm_moveldup_ps(b);
+    fft_vec im = _mm_movehdup_ps(b);
+    fft_vec swap = _mm_shuffle_ps(a, a, 0xB1);
+
+    return _mm_addsub_ps(_mm_mul_ps(a, re), _mm_mul_ps(swap, im));
+}
+
+static inline fft_vec v_mulj(fft_vec a) {
+    fft_vec swap = _mm_shuffle_ps(a, a, 0xB1);
+
+    return _mm_xor_ps(swap, _mm_set_ps(0.0f, -0.0f, 0.0f, -0.0f));
+}
+
+static inline fft_vec v_splat(const complex float *p) {
+    return _mm_castpd_ps(_mm_loaddup_pd((const double *) p));
+}
+
+static inline fft_vec v_gather(const complex float *p, size_t stride) {
+    __m128 v = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *) p);
+
+    return _mm_loadh_pi(v, (const __m64 *) (p + stride));
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+
+#include <arm_neon.h>
+
+#define FFT_VLEN 2
+
+typedef float32x4_t fft_vec;
+
+static inline fft_vec v_load(const complex float *p) {
+    return vld1q_f32((const float *) p);
+}
+
+static inline void v_store(complex float *p, fft_vec a) {
+    vst1q_f32((float *) p, a);
+}
+
+static inline fft_vec v_add(fft_vec a, fft_vec b) {
+    return vaddq_f32(a, b);
+}
+
+static inline fft_vec v_sub(fft_vec a, fft_vec b) {
+    return vsubq_f32(a, b);
+}
+
+static inline fft_vec v_cmul(fft_vec a, fft_vec b) {
+    static const float sign[4] = { -1.0f, 1.0f, -1.0f, 1.0f };
+    fft_vec re = vtrn1q_f32(b, b);
+    fft_vec im = vtrn2q_f32(b, b);
+    fft_vec swap = vrev64q_f32(a);
+
+    return vfmaq_f32(vmulq_f32(a, re), vmulq_f32(swap, im), vld1q_f32(sign));
+}
+
+static inline fft_vec v_mulj(fft_vec a) {
+    static const float sign[4] = { -1.0f, 1.0f, -1.0f, 1.0f };
+
+    return vmulq_f32(vrev64q_f32(a), vld1q_f32(sign));
+}
+
+static inline fft_vec v_splat(const complex float *p) {
+    return vreinterpretq_f32_f64(vld1q_dup_f64((const double *) p));
+}
+
+static inline fft_vec v_gather(const complex float *p, size_t stride) {
+    return vcombine_f32(vld1_f32((const float *) p), vld1_f32((const float *) (p + stride)));
+}
+
+#else
+
+#define FFT_VLEN 0
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
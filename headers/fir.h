@@ -17,6 +17,8 @@ extern "C" {
 #define GAIN            2.2f
 
 void fir(complex float [], bool, complex float [], int);
+void fir_bandpass(complex float [], bool, float);
+complex float fir_real(const complex float [], const float [], int);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,40 @@
+/*
+ * histogram.h
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qpsk_internal.h"
+
+// Defines
+
+/*
+ * Buckets per power of two, exact below HISTOGRAM_SUB
+ */
+#define HISTOGRAM_SUB       8
+#define HISTOGRAM_BUCKETS   (62 * HISTOGRAM_SUB)
+
+typedef struct {
+    uint32_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+} Histogram;
+
+// Prototypes
+
+void histogram_reset(Histogram *);
+void histogram_add(Histogram *, uint64_t);
+double histogram_mean(Histogram *);
+double histogram_percentile(Histogram *, double);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,40 @@
+/*
+ * lutmod.h
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qpsk_internal.h"
+#include "fir.h"
+
+// Defines
+
+/*
+ * Symbols in each table index, one byte of packed dibits
+ */
+#define LUT_GROUP       4
+
+/*
+ * Symbols spanned by the filter (10), and the
+ * number of groups to cover that span (3)
+ */
+#define LUT_SPAN        ((NTAPS + CYCLESF - 1) / CYCLESF)
+#define LUT_GROUPS      ((LUT_SPAN + LUT_GROUP - 1) / LUT_GROUP)
+
+// Prototypes
+
+void lutmod_init(bool);
+void lutmod_reset(void);
+void lutmod_modulate(complex float [], uint8_t [], int, int);
+void lutmod_skip(uint8_t [], int, int);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,83 @@
+/*
+ * metrics.h
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdatomic.h>
+
+#include "qpsk_internal.h"
+
+// Defines
+
+/*
+ * Upper bounds of the preamble matches histogram, the
+ * receiver accepts a sync above PREAMBLE_LENGTH - 30
+ */
+#define METRICS_MATCH_BOUNDS    { 64, 80, 90, 98, 108, 118, 128 }
+#define METRICS_MATCH_BUCKETS   7
+
+/*
+ * A sync whose correlation peak is under this times the mean
+ * symbol magnitude is counted as likely false
+ */
+#define METRICS_FALSE_SYNC      20.0f
+
+#define METRICS_NAME            32
+#define METRICS_TEXT            4096
+#define METRICS_PERIOD_MS       1000
+
+/*
+ * Counters and gauges of one modem. The receiver updates them
+ * with relaxed atomics, the export thread only reads them.
+ * Gauges hold the bits of a double.
+ */
+typedef struct {
+    char name[METRICS_NAME];                        // modem label
+
+    atomic_uint_fast64_t frames;                    // frames received
+    atomic_uint_fast64_t syncs;                     // preambles accepted
+    atomic_uint_fast64_t false_syncs;               // accepted with a weak peak
+    atomic_uint_fast64_t eof;                       // end of burst found
+    atomic_uint_fast64_t squelched;                 // frames skipped as dead air
+    atomic_uint_fast64_t cpu_ns;                    // receive CPU time
+
+    atomic_uint_fast64_t matches[METRICS_MATCH_BUCKETS + 1];
+    atomic_uint_fast64_t matches_sum;
+
+    atomic_uint_fast64_t offset;                    // coarse carrier offset (Hz)
+    atomic_uint_fast64_t frequency;                 // tracked carrier (Hz)
+    atomic_uint_fast64_t track_error;               // mean phase error (radians)
+    atomic_uint_fast64_t frame_cpu;                 // last frame CPU (seconds)
+    atomic_uint_fast64_t snr;                       // last frame SNR (dB)
+    atomic_uint_fast64_t snr_average;               // running SNR (dB)
+    atomic_uint_fast64_t evm;                       // last frame EVM
+} ModemMetrics;
+
+// Prototypes
+
+void metrics_init(ModemMetrics *, const char *);
+void metrics_add(atomic_uint_fast64_t *, uint64_t);
+void metrics_set(atomic_uint_fast64_t *, double);
+double metrics_get(atomic_uint_fast64_t *);
+void metrics_matches(ModemMetrics *, int);
+int metrics_format(ModemMetrics *, char [], int);
+
+bool metrics_export_start(ModemMetrics *, const char *, int);
+void metrics_export_stop(void);
+
+/*
+ * The receiver's metrics, in qpsk.c
+ */
+ModemMetrics *qpsk_metrics(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,43 @@
+/*
+ * nco.h
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qpsk_internal.h"
+
+/*
+ * Number of samples rotated from one block phase.
+ * Each lane is an independent multiply, so the
+ * inner loop has no loop-carried dependency.
+ */
+#define NCO_BLOCK       16
+
+typedef struct {
+    double phase;                       // block start phase (radians)
+    double step;                        // phase step per sample (radians)
+    double start;                       // phase at sample zero
+    uint64_t count;                     // samples generated since init
+    complex float lanes[NCO_BLOCK];     // per-lane phase steps
+} NCO;
+
+// Prototypes
+
+void nco_init(NCO *, float, float);
+void nco_set_frequency(NCO *, float, float);
+void nco_mix(NCO *, complex float [], int);
+void nco_mix_decimated(NCO *, complex float [], int, int, int, int);
+void nco_advance(NCO *, int);
+complex float nco_phasor(NCO *);
+float nco_phase_error(NCO *);
+
+#ifdef __cplusplus
+}
+#endif
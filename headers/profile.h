@@ -0,0 +1,97 @@
+/*
+ * profile.h
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qpsk_internal.h"
+
+#ifdef QPSK_PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILE_TSC
+#else
+#include <time.h>
+#endif
+#endif
+
+// Defines
+
+typedef enum {
+    profile_convert,            // PCM to float
+    profile_fir,                // bandpass filter and decimate
+    profile_mix,                // translate to baseband
+    profile_acquire,            // coarse frequency, when hunting
+    profile_search,             // preamble correlation search
+    profile_equalize,           // equalizer training
+    profile_demod,              // data symbols
+    profile_frame,              // the whole of qpsk_rx_frame
+    PROFILE_STAGES
+} ProfileStage;
+
+typedef struct {
+    const char *name;
+    uint64_t count;             // times the stage ran
+    double mean;                // nanoseconds
+    double p50;
+    double p99;
+    double max;
+} ProfileStats;
+
+/*
+ * Stage timing in the receiver, only when compiled with
+ * QPSK_PROFILE. PROFILE_BEGIN starts the frame, each
+ * PROFILE_MARK ends a stage begun at the last mark, and
+ * PROFILE_SKIP starts the next stage without recording.
+ */
+#ifdef QPSK_PROFILE
+
+extern uint64_t profile_frame_start;
+extern uint64_t profile_last;
+
+static inline uint64_t profile_ticks(void) {
+#ifdef PROFILE_TSC
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t) ts.tv_sec * 1000000000ULL) + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+#define PROFILE_BEGIN()         (profile_frame_start = profile_last = profile_ticks())
+#define PROFILE_MARK(stage)     profile_mark(stage)
+#define PROFILE_SKIP()          (profile_last = profile_ticks())
+#define PROFILE_END()           profile_end()
+
+#else
+
+#define PROFILE_BEGIN()
+#define PROFILE_MARK(stage)
+#define PROFILE_SKIP()
+#define PROFILE_END()
+
+#endif
+
+// Prototypes
+
+#ifdef QPSK_PROFILE
+void profile_mark(ProfileStage);
+void profile_end(void);
+#endif
+
+void profile_reset(void);
+bool profile_stats(ProfileStage, ProfileStats *);
+
+#ifdef __cplusplus
+}
+#endif
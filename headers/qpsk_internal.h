@@ -24,9 +24,22 @@ extern "C" {
 
 #define TX_FILENAME "/tmp/spectrum-filtered.raw"
 #define RX_FILENAME "/tmp/databits.txt"
+#define TRACE_FILENAME "/tmp/qpsk-trace.bin"
+
+/*
+ * Set to trace the loopback test, to a file name,
+ * or empty for TRACE_FILENAME
+ */
+#define TRACE_ENV "QPSK_TRACE"
 
 #define EOF_COST_VALUE  5.0f
 
+/*
+ * Suggested receive squelch, frame RMS in dB of full scale.
+ * The squelch is off until qpsk_rx_squelch() is called.
+ */
+#define SQUELCH_LEVEL   -60.0f
+
 #define EQ_LENGTH       5
 
 #define FS              8000.0f
@@ -41,17 +54,26 @@ extern "C" {
 #define FRAME_SYMBOLS   (DATA_SYMBOLS * NS)
 #define DATA_SAMPLES    (DATA_SYMBOLS * CYCLES * NS)
 
-// Data Size = DATA_SYMBOLS * NS * CYCLES
-#define DATA_SIZE       1240
+#define PREAMBLE_LENGTH 128
+#define PREAMBLE_SIZE   (PREAMBLE_LENGTH * CYCLESF)
+
+// Data Size = DATA_SYMBOLS * NS * CYCLES (1240)
+#define DATA_SIZE       (DATA_SYMBOLS * NS * CYCLESF)
     
-// Frame Size = Preamble Size + DATA_SYMBOLS * NS * CYCLES
-#define FRAME_SIZE      1880
+// Frame Size = Preamble Size + DATA_SYMBOLS * NS * CYCLES (1880)
+#define FRAME_SIZE      (PREAMBLE_SIZE + DATA_SIZE)
 
-// (DATA_SYMBOLS * 2 bits * NS)
-#define BITS_PER_FRAME  496
+// Frame Size at the 1600 baud symbol rate (376)
+#define DECIMATED_SIZE  (FRAME_SIZE / CYCLESF)
 
-#define PREAMBLE_LENGTH 128
-#define PREAMBLE_SIZE   (PREAMBLE_LENGTH * CYCLESF)
+// (DATA_SYMBOLS * 2 bits * NS) (496)
+#define BITS_PER_FRAME  (FRAME_SYMBOLS * 2)
+
+// Packed four symbols per byte (62)
+#define BYTES_PER_FRAME (BITS_PER_FRAME / 8)
+
+// Bytes holding the data symbols of one received frame (8)
+#define RX_BYTES        ((DATA_SYMBOLS + 3) / 4)
 
 #ifndef M_PI
 #define M_PI            3.14159265358979323846f
@@ -74,14 +96,89 @@ typedef enum {
     process
 } RXState;
 
+// Structures
+
+/*
+ * Carrier tracking loop state, updated each frame
+ */
+typedef struct {
+    float phase;        // radians
+    float frequency;    // Hz
+    float error;        // mean absolute phase error over the frame (radians)
+    int symbols;        // symbols tracked in the frame
+} TrackState;
+
+/*
+ * Signal quality of the data symbols of a frame, from the
+ * equalizer decision errors, so only valid while the
+ * decisions are mostly right
+ */
+typedef struct {
+    float evm;          // rms error vector over rms constellation
+    float snr;          // dB, from the evm
+    float snr_average;  // dB, running average over the frames
+    int symbols;        // symbols measured in the frame
+} FrameQuality;
+
+/*
+ * Receive timestamps of the last valid frame, monotonic nanoseconds.
+ *
+ * buffered counts from the last data symbol to the end of the frame
+ * just handed over. That symbol may be in an earlier frame, so it can
+ * be more than FRAME_SIZE.
+ */
+typedef struct {
+    int64_t arrival;    // frame samples handed to the receiver
+    int64_t sync;       // preamble accepted
+    int64_t emit;       // payload returned
+    int buffered;       // samples after the last data symbol
+} RxTimes;
+
+typedef enum {
+    latency_sync,       // arrival to sync
+    latency_emit,       // arrival to emit
+    latency_bits,       // last data sample to emit, with realtime input
+    LATENCY_KINDS
+} LatencyKind;
+
+/*
+ * Latency distribution over the valid frames, nanoseconds
+ */
+typedef struct {
+    uint64_t count;
+    double mean;
+    double p50;
+    double p99;
+    double max;
+} LatencyStats;
+
 // Prototypes
 
 float cnormf(complex float);
 
+bool qpsk_create(void);
+
 complex float qpsk_mod(uint8_t [], int);
 void qpsk_demod(uint8_t bits[], complex float symbol);
+complex float qpsk_mod_packed(uint8_t [], int);
+void qpsk_demod_packed(uint8_t [], int, complex float);
+void qpsk_put_dibit(uint8_t [], int, uint8_t);
 int qpsk_rx_frame(int16_t [], uint8_t []);
 int qpsk_tx_frame(int16_t [], complex float [], int, bool);
+int qpsk_tx_packed(int16_t [], uint8_t [], int, int, bool);
+int qpsk_tx_preamble(int16_t []);
+void qpsk_rx_track(TrackState *);
+void qpsk_rx_squelch(float);
+void qpsk_rx_quality(FrameQuality *);
+int qpsk_rx_sync(void);
+void qpsk_rx_times(RxTimes *);
+void qpsk_rx_latency(LatencyKind, LatencyStats *);
+void qpsk_rx_latency_reset(void);
+int64_t qpsk_now_ns(void);
+float qpsk_correlate(complex float [], int);
+bool qpsk_audio_rates(int, int, bool);
+int qpsk_rx_audio(int16_t [], int, uint8_t []);
+int qpsk_tx_audio(int16_t [], int16_t [], int);
 
 #ifdef __cplusplus
 }
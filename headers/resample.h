@@ -0,0 +1,52 @@
+/*
+ * resample.h
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qpsk_internal.h"
+
+// Defines
+
+/*
+ * Taps for each polyphase branch, per unit of decimation. With the
+ * root raised cosine filter shared, the resampler only has to keep
+ * images and aliases out of the signal band, so it needs far fewer.
+ */
+#define RESAMPLE_TAPS           40
+#define RESAMPLE_TAPS_SHARED    14
+
+/*
+ * Input samples between history copies
+ */
+#define RESAMPLE_BUFFER         512
+
+typedef struct {
+    int up;                     // interpolation L
+    int down;                   // decimation M
+    int taps;                   // taps per branch
+    int phase;                  // next output branch
+    int write;                  // next sample position
+    int length;                 // buffer length
+    float *coeff;               // [up][taps], newest sample first
+    float *buffer;              // input history
+} Resampler;
+
+// Prototypes
+
+bool resample_init(Resampler *, int, int, bool);
+void resample_free(Resampler *);
+void resample_reset(Resampler *);
+int resample_process(Resampler *, const float [], int, float []);
+int resample_max_output(Resampler *, int);
+
+#ifdef __cplusplus
+}
+#endif
@@ -16,6 +16,11 @@ extern "C" {
 #define SEED 0x4A80
 #define BITS 2
 
+/*
+ * Payload of one frame packed in 64 bit words
+ */
+#define FRAME_WORDS ((BITS_PER_FRAME + 63) / 64)
+
 /* Constants  */
 
 typedef enum {
@@ -28,6 +33,8 @@ typedef enum {
 
 void scramble_init(SRegister);
 int scramble(uint8_t *, SRegister);
+void scramble_keystream(uint16_t *, uint64_t [], int);
+void scramble_bytes(uint8_t [], int);
 
 #ifdef __cplusplus
 }
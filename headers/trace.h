@@ -0,0 +1,63 @@
+/*
+ * trace.h
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qpsk_internal.h"
+
+// Defines
+
+/*
+ * Records in the ring, a power of two (1 MiB)
+ */
+#define TRACE_RING          65536
+
+/*
+ * Drain thread sleep when the ring is empty (ms)
+ */
+#define TRACE_DRAIN_MS      10
+
+#define TRACE_MAGIC         "QPSKTRC1"
+
+typedef enum {
+    trace_symbol = 1,           // index symbol, a + jb the decimated symbol
+    trace_peak,                 // index max_index, a correlation peak, b mean magnitude
+    trace_match,                // index equalizer matches of the preamble
+    trace_sync,                 // index rx_timing, a rx_sync, b coarse offset (Hz)
+    trace_eq,                   // index symbols, a summed equalizer error, b track error
+    trace_dropped               // frame records lost with the ring full
+} TraceType;
+
+#define TRACE_MASK(type)    (1U << (type))
+#define TRACE_ALL           0xFFFFFFFFU
+
+/*
+ * 16 bytes, written to the file as is after the
+ * TRACE_MAGIC and a uint32_t record size
+ */
+typedef struct {
+    uint32_t frame;             // receive frame, from 1
+    uint16_t type;
+    uint16_t index;
+    float a;
+    float b;
+} TraceRecord;
+
+// Prototypes
+
+bool trace_open(const char *, uint32_t);
+void trace_close(void);
+bool trace_enabled(TraceType);
+void trace_write(TraceType, uint32_t, int, float, float);
+
+#ifdef __cplusplus
+}
+#endif
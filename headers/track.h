@@ -0,0 +1,43 @@
+/*
+ * track.h
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qpsk_internal.h"
+#include "acquire.h"
+
+// Defines
+
+/*
+ * Loop noise bandwidth normalized to the symbol rate,
+ * and the damping factor of the second order loop
+ */
+#define TRACK_BW        0.01f
+#define TRACK_DAMPING   0.707f
+
+/*
+ * Largest frequency the loop follows (+/- Hz), the residual the
+ * coarse acquisition leaves is within a bin, the rest allows for
+ * drift over a burst. Decisions on noise cannot run it further.
+ */
+#define TRACK_RANGE     (8.0f * ACQ_BIN)
+
+// Prototypes
+
+void track_init(void);
+void track_reset(void);
+complex float track_derotate(complex float);
+complex float track_update(complex float, complex float);
+void track_frame(TrackState *);
+
+#ifdef __cplusplus
+}
+#endif
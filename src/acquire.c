@@ -0,0 +1,139 @@
+/*
+ * acquire.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Coarse frequency offset acquisition
+ *
+ * The preamble is BPSK on the 45 degree axis, so squaring each
+ * symbol removes the modulation, (+/-(1 + j))^2 = 2j. The QPSK data
+ * symbols square to +/-2j at random though, and as the preamble is
+ * sent at half amplitude, the data would bury the tone.
+ *
+ * Squaring twice, (2j)^2 = (-2j)^2 = -4, so both the preamble and
+ * the data leave a tone at four times the carrier offset. This gives
+ * an unambiguous range of +/- RS / 8 or 200 Hz.
+ *
+ * One zero padded FFT over the frame finds the tone,
+ * and the receiver is then retuned once per burst.
+ */
+
+#include "acquire.h"
+#include "fft.h"
+
+// Locals
+
+static fft_cfg acq_cfg;
+
+static complex float acq_out[ACQ_FFT_SIZE];
+
+// Functions
+
+/*
+ * Returns the arena memory needed
+ */
+size_t acquire_memory() {
+    return fft_plan_memory(ACQ_FFT_SIZE);
+}
+
+/*
+ * Returns false if the arena has no room for the FFT plan
+ */
+bool acquire_init() {
+    acq_cfg = fft_plan(ACQ_FFT_SIZE, 0);
+
+    return acq_cfg != NULL;
+}
+
+/*
+ * Estimate the carrier offset in Hz of the burst
+ * in the ACQ_SYMBOLS starting at index.
+ *
+ * Returns false if no preamble tone was found
+ */
+bool acquire_offset(complex float symbol[], int index, float *offset) {
+    for (size_t i = 0, j = index; i < ACQ_FFT_SIZE; i++, j++) {
+        if (i < ACQ_SYMBOLS) {
+            complex float square = symbol[j] * symbol[j];
+
+            acq_out[i] = square * square;
+        } else {
+            acq_out[i] = 0.0f;
+        }
+    }
+
+    fft_inplace(acq_cfg, acq_out);
+
+    /*
+     * Only search the bins within the lock range, plus
+     * a main lobe so the interpolation works at the edges.
+     *
+     * Bin k is an offset of k * ACQ_BIN Hz
+     */
+    int lobe = (ACQ_FFT_SIZE * 2) / ACQ_SYMBOLS;
+    int range = (int) (ACQ_RANGE / ACQ_BIN) + lobe;
+    float max_value = 0.0f;
+    int max_bin = 0;
+
+    for (int k = -range; k <= range; k++) {
+        float val = cnormf(acq_out[(k + ACQ_FFT_SIZE) % ACQ_FFT_SIZE]);
+
+        if (val > max_value) {
+            max_value = val;
+            max_bin = k;
+        }
+    }
+
+    /*
+     * Noise floor from the bins outside the tone main lobe
+     */
+    float mean = 0.0f;
+    int bins = 0;
+
+    for (int k = -range; k <= range; k++) {
+        if (abs(k - max_bin) > lobe) {
+            mean += cnormf(acq_out[(k + ACQ_FFT_SIZE) % ACQ_FFT_SIZE]);
+            bins++;
+        }
+    }
+
+    mean /= (float) bins;
+
+    if ((mean == 0.0f) || (max_value < (mean * ACQ_THRESHOLD))) {
+        return false;
+    }
+
+    /*
+     * Parabolic interpolation between the neighbor bins
+     */
+    float a = cabsf(acq_out[(max_bin - 1 + ACQ_FFT_SIZE) % ACQ_FFT_SIZE]);
+    float b = cabsf(acq_out[(max_bin + ACQ_FFT_SIZE) % ACQ_FFT_SIZE]);
+    float c = cabsf(acq_out[(max_bin + 1 + ACQ_FFT_SIZE) % ACQ_FFT_SIZE]);
+    float den = a - (2.0f * b) + c;
+    float delta = 0.0f;
+
+    if (den != 0.0f) {
+        delta = 0.5f * (a - c) / den;
+    }
+
+    *offset = ((float) max_bin + delta) * ACQ_BIN;
+
+    return true;
+}
+
+/*
+ * Remove the offset (Hz) from symbols already at the 1600 baud rate.
+ *
+ * The correction is zero phase at symbol index origin, which may be
+ * fractional, so it can continue into an oscillator retuned there.
+ */
+void acquire_derotate(complex float symbol[], int length, float offset, float origin) {
+    complex float rect = cmplxconj(TAU * offset / RS);
+    complex float phase = cmplx(TAU * offset * origin / RS);
+
+    for (int i = 0; i < length; i++) {
+        symbol[i] *= phase;
+        phase *= rect;
+    }
+}
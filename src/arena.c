@@ -0,0 +1,160 @@
+/*
+ * arena.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Fixed memory arena for real-time use
+ *
+ * All the working memory of the modem is taken from one block,
+ * allocated when the modem is created. Nothing is returned to the
+ * arena, so after creation the transmit and receive paths never
+ * call the heap allocator.
+ *
+ * Any heap allocation the modem does make goes through qpsk_malloc().
+ * When compiled with ALLOC_CHECK the C library malloc(), calloc() and
+ * realloc() are replaced by counting versions, so every allocation on
+ * the checking thread is seen, including those made inside stdio and
+ * pthread_create(), and a test can check that none happen once
+ * running. The counting versions call the glibc allocator directly.
+ */
+
+#include "arena.h"
+
+// Locals
+
+static uint8_t *arena_base;
+static size_t arena_size;
+static size_t arena_next;
+
+#ifdef ALLOC_CHECK
+static _Thread_local bool alloc_checking;
+static _Thread_local int alloc_count;
+#endif
+
+// Functions
+
+#ifdef ALLOC_CHECK
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+/*
+ * The program's heap allocator, counted when checking
+ */
+void *malloc(size_t size) {
+    if (alloc_checking == true) {
+        alloc_count++;
+    }
+
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    if (alloc_checking == true) {
+        alloc_count++;
+    }
+
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    if (alloc_checking == true) {
+        alloc_count++;
+    }
+
+    return __libc_realloc(ptr, size);
+}
+
+#endif
+
+void *qpsk_malloc(size_t size) {
+    return malloc(size);
+}
+
+void qpsk_free(void *ptr) {
+    free(ptr);
+}
+
+/*
+ * Returns false if the arena could not be allocated
+ */
+bool arena_create(size_t size) {
+    arena_destroy();
+
+    arena_base = (uint8_t *) qpsk_malloc(size);
+
+    if (arena_base == NULL) {
+        return false;
+    }
+
+    arena_size = size;
+    arena_next = 0;
+
+    return true;
+}
+
+void arena_destroy() {
+    if (arena_base != NULL) {
+        qpsk_free(arena_base);
+    }
+
+    arena_base = NULL;
+    arena_size = 0;
+    arena_next = 0;
+}
+
+/*
+ * Returns NULL if the arena is not created, or is full
+ */
+void *arena_alloc(size_t size) {
+    size_t start = (arena_next + (ARENA_ALIGN - 1)) & ~((size_t) ARENA_ALIGN - 1);
+
+    if ((arena_base == NULL) || ((start + size) > arena_size)) {
+        return NULL;
+    }
+
+    arena_next = start + size;
+
+    return &arena_base[start];
+}
+
+size_t arena_used() {
+    return arena_next;
+}
+
+bool arena_ready() {
+    return arena_base != NULL;
+}
+
+/*
+ * Returns true if ptr was taken from the arena
+ */
+bool arena_owns(const void *ptr) {
+    const uint8_t *p = (const uint8_t *) ptr;
+
+    return (arena_base != NULL) && (p >= arena_base) && (p < (arena_base + arena_size));
+}
+
+#ifdef ALLOC_CHECK
+
+/*
+ * Start counting heap allocations on this thread
+ */
+void alloc_check_begin() {
+    alloc_count = 0;
+    alloc_checking = true;
+}
+
+/*
+ * Stop counting, and return the heap
+ * allocations made since the start
+ */
+int alloc_check_end() {
+    alloc_checking = false;
+
+    return alloc_count;
+}
+
+#endif
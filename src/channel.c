@@ -0,0 +1,281 @@
+/*
+ * channel.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * HF channel simulator for the transmit audio
+ *
+ * The real 8 kHz samples are first skewed in time by the sample clock
+ * error, with cubic interpolation. A Hilbert transformer then gives the
+ * analytic signal, so the Watterson fading and the carrier offset and
+ * drift are complex multiplies. The real part has white noise added
+ * for the Eb/N0, and is returned as samples again.
+ *
+ * The two Watterson paths have equal mean power. Each path gain is a
+ * sum of sinusoids with Gaussian distributed Doppler frequencies, so
+ * its spectrum tends to the Gaussian of the model with any spread.
+ *
+ * The work is done CHANNEL_BLOCK samples at a time, the gains and
+ * frequency being updated per block, so the inner loops are plain
+ * array arithmetic. Output is delayed by the Hilbert filter, half of
+ * CHANNEL_HILBERT, and by up to a block held waiting.
+ */
+
+#include "channel.h"
+
+// Defines
+
+#define HILBERT_CENTER  ((CHANNEL_HILBERT - 1) / 2)
+
+// Functions
+
+/*
+ * xorshift64*, on any state, which must not be zero
+ */
+uint64_t channel_xorshift(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+ * Each channel has its own state
+ */
+uint64_t channel_random(Channel *ch) {
+    return channel_xorshift(&ch->rng);
+}
+
+/*
+ * Uniform in (0, 1)
+ */
+static float uniform(Channel *ch) {
+    return ((float) (channel_random(ch) >> 40) + 0.5f) / 16777216.0f;
+}
+
+/*
+ * Unit variance Gaussian
+ */
+float channel_gauss(Channel *ch) {
+    return sqrtf(-2.0f * logf(uniform(ch))) * cosf(TAU * uniform(ch));
+}
+
+/*
+ * Path gain at time t, each path has half the power
+ */
+static complex float fading(Channel *ch, int path, double t) {
+    complex float sum = 0.0f;
+
+    for (int k = 0; k < CHANNEL_SINUSOIDS; k++) {
+        float phase = fmodf((float) fmod(TAU * ch->doppler[path][k] * t, TAU) + ch->phases[path][k], TAU);
+
+        sum += cmplx(phase);
+    }
+
+    return sum * (1.0f / sqrtf(2.0f * CHANNEL_SINUSOIDS));
+}
+
+/*
+ * Set up the channel, seed selects the noise and fading
+ */
+void channel_init(Channel *ch, const ChannelConfig *config, uint64_t seed) {
+    memset(ch, 0, sizeof (Channel));
+
+    ch->config = *config;
+    ch->rng = (seed == 0) ? 1 : seed;
+
+    float power = (config->power > 0.0f) ? config->power : CHANNEL_POWER;
+
+    if (config->ebn0 < CHANNEL_CLEAN) {
+        float ratio = powf(10.0f, config->ebn0 / 10.0f);
+
+        ch->sigma = sqrtf((power * FS) / (2.0f * (RS * 2.0f) * ratio));
+    }
+
+    /*
+     * Blackman windowed Hilbert transformer, odd taps only
+     */
+    for (int k = 0; k < CHANNEL_HILBERT; k++) {
+        int n = k - HILBERT_CENTER;
+        float w = 0.42f - (0.5f * cosf(TAU * (float) k / (float) (CHANNEL_HILBERT - 1)))
+                + (0.08f * cosf(2.0f * TAU * (float) k / (float) (CHANNEL_HILBERT - 1)));
+
+        ch->hilbert[k] = ((n & 1) != 0) ? (2.0f / (M_PI * (float) n)) * w : 0.0f;
+    }
+
+    ch->delay = (int) lrintf(config->delay * FS / 1000.0f);
+
+    if (ch->delay > CHANNEL_MAX_DELAY) {
+        ch->delay = CHANNEL_MAX_DELAY;
+    } else if (ch->delay < 0) {
+        ch->delay = 0;
+    }
+
+    /*
+     * Watterson spread is twice the standard deviation
+     */
+    for (int p = 0; p < 2; p++) {
+        for (int k = 0; k < CHANNEL_SINUSOIDS; k++) {
+            ch->doppler[p][k] = channel_gauss(ch) * (config->spread / 2.0f);
+            ch->phases[p][k] = TAU * uniform(ch);
+        }
+    }
+
+    /*
+     * Interpolation starts from the gains at time zero
+     */
+    ch->gain[0] = fading(ch, 0, 0.0);
+    ch->gain[1] = fading(ch, 1, 0.0);
+
+    nco_init(&ch->nco, config->offset, FS);
+
+    ch->skew_step = 1.0 / (1.0 + ((double) config->ppm * 1e-6));
+}
+
+/*
+ * Most output samples from length more input samples
+ */
+int channel_max_output(Channel *ch, int length) {
+    return (int) ((double) (length + 2) / ch->skew_step) + CHANNEL_BLOCK;
+}
+
+/*
+ * Run one block of skewed samples through the rest of the channel
+ */
+static void channel_block(Channel *ch, const float in[], int16_t out[]) {
+    complex float analytic[CHANNEL_BLOCK];
+    float *x = ch->history;
+
+    /*
+     * Real to analytic, the real part is the
+     * input delayed to the filter center
+     */
+    memcpy(&x[CHANNEL_HILBERT - 1], in, sizeof (float) * CHANNEL_BLOCK);
+
+    for (int i = 0; i < CHANNEL_BLOCK; i++) {
+        float im = 0.0f;
+
+        for (int k = 0; k < CHANNEL_HILBERT; k += 2) {
+            im += ch->hilbert[k] * x[i + (CHANNEL_HILBERT - 1) - k];
+        }
+
+        analytic[i] = x[i + HILBERT_CENTER] + im * I;
+    }
+
+    memmove(x, &x[CHANNEL_BLOCK], sizeof (float) * (CHANNEL_HILBERT - 1));
+
+    /*
+     * Two path fading, gains interpolated across the block
+     */
+    if (ch->config.spread > 0.0f) {
+        complex float *d = ch->paths;
+        double end = ch->time + (CHANNEL_BLOCK / FS);
+        complex float g0 = ch->gain[0];
+        complex float g1 = ch->gain[1];
+        complex float step0 = (fading(ch, 0, end) - g0) / (float) CHANNEL_BLOCK;
+        complex float step1 = (fading(ch, 1, end) - g1) / (float) CHANNEL_BLOCK;
+
+        memcpy(&d[CHANNEL_MAX_DELAY], analytic, sizeof (complex float) * CHANNEL_BLOCK);
+
+        for (int i = 0; i < CHANNEL_BLOCK; i++) {
+            analytic[i] = (g0 * d[CHANNEL_MAX_DELAY + i]) + (g1 * d[CHANNEL_MAX_DELAY + i - ch->delay]);
+
+            g0 += step0;
+            g1 += step1;
+        }
+
+        memmove(d, &d[CHANNEL_BLOCK], sizeof (complex float) * CHANNEL_MAX_DELAY);
+
+        ch->gain[0] = g0;
+        ch->gain[1] = g1;
+    }
+
+    /*
+     * Carrier offset, the drift is applied per block
+     */
+    if (ch->config.offset != 0.0f || ch->config.drift != 0.0f) {
+        nco_set_frequency(&ch->nco, ch->config.offset + (ch->config.drift * (float) ch->time), FS);
+        nco_mix(&ch->nco, analytic, CHANNEL_BLOCK);
+    }
+
+    /*
+     * Noise, both Box-Muller outputs used
+     */
+    float noise[CHANNEL_BLOCK];
+
+    if (ch->sigma > 0.0f) {
+        for (int i = 0; i < CHANNEL_BLOCK; i += 2) {
+            float r = ch->sigma * sqrtf(-2.0f * logf(uniform(ch)));
+            float a = TAU * uniform(ch);
+
+            noise[i] = r * cosf(a);
+            noise[i + 1] = r * sinf(a);
+        }
+    } else {
+        memset(noise, 0, sizeof (noise));
+    }
+
+    for (int i = 0; i < CHANNEL_BLOCK; i++) {
+        float sample = crealf(analytic[i]) + noise[i];
+
+        sample = fmaxf(-32768.0f, fminf(32767.0f, sample));
+        out[i] = (int16_t) lrintf(sample);
+    }
+
+    ch->time += CHANNEL_BLOCK / FS;
+}
+
+/*
+ * Cubic (Catmull-Rom) between h[1] and h[2], mu in [0, 1)
+ */
+static float cubic(const float h[], float mu) {
+    float a = (-0.5f * h[0]) + (1.5f * h[1]) - (1.5f * h[2]) + (0.5f * h[3]);
+    float b = h[0] - (2.5f * h[1]) + (2.0f * h[2]) - (0.5f * h[3]);
+    float c = (-0.5f * h[0]) + (0.5f * h[2]);
+
+    return (((a * mu + b) * mu + c) * mu) + h[1];
+}
+
+/*
+ * Pass length samples through the channel, returning the number
+ * of output samples, at most channel_max_output(length)
+ */
+int channel_process(Channel *ch, const int16_t in[], int length, int16_t out[]) {
+    int count = 0;
+
+    for (int i = 0; i < length; i++) {
+        if (ch->config.ppm == 0.0f) {
+            ch->pending[ch->pending_count++] = (float) in[i];
+        } else {
+            float *h = ch->skew_history;
+
+            h[0] = h[1];
+            h[1] = h[2];
+            h[2] = h[3];
+            h[3] = (float) in[i];
+
+            while (ch->skew_position < 1.0) {
+                ch->pending[ch->pending_count++] = cubic(h, (float) ch->skew_position);
+                ch->skew_position += ch->skew_step;
+
+                if (ch->pending_count == CHANNEL_BLOCK) {
+                    channel_block(ch, ch->pending, &out[count]);
+                    count += CHANNEL_BLOCK;
+                    ch->pending_count = 0;
+                }
+            }
+
+            ch->skew_position -= 1.0;
+        }
+
+        if (ch->pending_count == CHANNEL_BLOCK) {
+            channel_block(ch, ch->pending, &out[count]);
+            count += CHANNEL_BLOCK;
+            ch->pending_count = 0;
+        }
+    }
+
+    return count;
+}
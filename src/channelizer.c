@@ -0,0 +1,181 @@
+/*
+ * channelizer.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Polyphase FFT channelizer
+ *
+ * Splits a wideband complex stream at (channels * FS) into critically
+ * sampled channels at FS, channel k centered on (k * FS), with the
+ * upper half of the channels being the negative frequencies.
+ *
+ * Channel k is the input mixed down by (k * FS), lowpass filtered and
+ * decimated by M = channels. Splitting the filter into M branches of
+ * CHAN_PHASE_TAPS taps, branch r sees every M-th sample, and the mix
+ * only rotates each branch output by exp(j * 2pi * k * r / M). So one
+ * M point inverse FFT of the branch outputs gives every channel, in
+ * place of M mixers and M filters.
+ *
+ * The prototype is a windowed sinc cut off at the channel edge. The
+ * 1600 baud carrier only uses the center of each channel, so this
+ * leaves the root raised cosine matched filter to the receiver.
+ *
+ * Each Channelizer owns its memory and FFT config, so one can be
+ * run per wideband stream.
+ */
+
+#include "channelizer.h"
+#include "arena.h"
+
+// Functions
+
+void channelizer_destroy(Channelizer *ch) {
+    qpsk_free(ch->prototype);
+    qpsk_free(ch->buffer);
+    qpsk_free(ch->branch);
+    qpsk_free(ch->nco);
+    fft_free(ch->cfg);
+
+    ch->prototype = NULL;
+    ch->buffer = NULL;
+    ch->branch = NULL;
+    ch->nco = NULL;
+    ch->cfg = NULL;
+    ch->channels = 0;
+}
+
+/*
+ * Set up for the number of channels, the input
+ * rate being (channels * FS). Returns false if
+ * the memory or FFT could not be allocated.
+ *
+ * The Channelizer must be zeroed before first use.
+ */
+bool channelizer_create(Channelizer *ch, int count) {
+    channelizer_destroy(ch);
+
+    if (count < 2) {
+        return false;
+    }
+
+    ch->channels = count;
+    ch->taps = count * CHAN_PHASE_TAPS;
+    ch->length = ch->taps + (count * CHAN_BUFFER_BLOCKS);
+
+    ch->prototype = (float *) qpsk_malloc(sizeof (float) * ch->taps);
+    ch->buffer = (complex float *) qpsk_malloc(sizeof (complex float) * ch->length);
+    ch->branch = (complex float *) qpsk_malloc(sizeof (complex float) * count);
+    ch->nco = (NCO *) qpsk_malloc(sizeof (NCO) * count);
+    ch->cfg = fft_alloc(count, 1, NULL, NULL);
+
+    if (ch->prototype == NULL || ch->buffer == NULL || ch->branch == NULL ||
+            ch->nco == NULL || ch->cfg == NULL) {
+        channelizer_destroy(ch);
+        return false;
+    }
+
+    /*
+     * Blackman windowed sinc, cutoff FS / 2 at the input
+     * rate, normalized to unity gain at the channel center
+     */
+    float sum = 0.0f;
+
+    for (int i = 0; i < ch->taps; i++) {
+        float t = (float) i - ((float) (ch->taps - 1) / 2.0f);
+        float x = M_PI * t / (float) count;
+        float w = 0.42f - (0.5f * cosf(TAU * (float) i / (float) (ch->taps - 1)))
+                + (0.08f * cosf(2.0f * TAU * (float) i / (float) (ch->taps - 1)));
+
+        ch->prototype[i] = ((t == 0.0f) ? 1.0f : (sinf(x) / x)) * w;
+        sum += ch->prototype[i];
+    }
+
+    for (int i = 0; i < ch->taps; i++) {
+        ch->prototype[i] /= sum;
+    }
+
+    for (int i = 0; i < ch->length; i++) {
+        ch->buffer[i] = 0.0f;
+    }
+
+    for (int k = 0; k < count; k++) {
+        nco_init(&ch->nco[k], CENTER, FS);
+    }
+
+    ch->write = ch->taps;
+    ch->count = 0;
+
+    return true;
+}
+
+/*
+ * One output for every channel, the newest input
+ * sample being at (write - 1)
+ */
+static void channelize(Channelizer *ch, complex float *out[], int index) {
+    const complex float *x = &ch->buffer[ch->write - 1];
+    const int m = ch->channels;
+
+    for (int r = 0; r < m; r++) {
+        complex float sum = 0.0f;
+
+        for (int p = 0; p < ch->taps; p += m) {
+            sum += x[-(p + r)] * ch->prototype[p + r];
+        }
+
+        ch->branch[r] = sum;
+    }
+
+    fft_inplace(ch->cfg, ch->branch);
+
+    for (int k = 0; k < m; k++) {
+        out[k][index] = ch->branch[k];
+    }
+}
+
+/*
+ * Channelize length wideband samples. Each out[k] must hold
+ * (length / channels) + 1 samples, and the number written
+ * to every channel is returned.
+ */
+int channelizer_process(Channelizer *ch, complex float in[], int length, complex float *out[]) {
+    int outputs = 0;
+
+    for (int i = 0; i < length; i++) {
+        if (ch->write == ch->length) {
+            memmove(ch->buffer, &ch->buffer[ch->length - ch->taps], sizeof (complex float) * ch->taps);
+            ch->write = ch->taps;
+        }
+
+        ch->buffer[ch->write++] = in[i];
+
+        if (++ch->count == ch->channels) {
+            channelize(ch, out, outputs++);
+            ch->count = 0;
+        }
+    }
+
+    return outputs;
+}
+
+/*
+ * Convert channel samples to receiver input, mixing the baseband up
+ * to CENTER and keeping the real part, as qpsk_rx_frame() expects.
+ * The baseband samples are mixed in place.
+ */
+void channelizer_audio(Channelizer *ch, int channel, complex float baseband[], int16_t audio[], int length) {
+    nco_mix(&ch->nco[channel], baseband, length);
+
+    for (int i = 0; i < length; i++) {
+        float sample = crealf(baseband[i]) * 16384.0f;
+
+        if (sample > 32767.0f) {
+            sample = 32767.0f;
+        } else if (sample < -32768.0f) {
+            sample = -32768.0f;
+        }
+
+        audio[i] = (int16_t) sample;
+    }
+}
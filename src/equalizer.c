@@ -9,7 +9,7 @@
 
 #include "kalman.h"
 #include "equalizer.h"
-#include "scramble.h"
+#include "track.h"
 
 // Externals
 
@@ -17,6 +17,17 @@ extern complex float eq_coeff[];
 extern complex float kalman_gain[];
 extern float kalman_y;
 
+// Locals
+
+/*
+ * Decision error power of the data symbols, summed over
+ * the frame, and averaged over the frames of the burst
+ */
+static float error_power;
+static int error_symbols;
+static float average_power;
+static bool average_started;
+
 // Functions
 
 /*
@@ -58,33 +69,77 @@ float train_eq(complex float in[], int index, float ref) {
 }
 
 /*
- * Returns the bits, and distance for the PSK symbol
- * and updates the equalization filter
+ * Stores the dibit of the PSK symbol at position symbol of the packed
+ * payload, returns the distance, and updates the equalization filter
+ * and carrier tracking
  */
-float data_eq(uint8_t *bits, complex float in[], int index) {
-    uint8_t dibit[2]; // IQ bit values
-
+float data_eq(uint8_t bytes[], int symbol_index, complex float in[], int index) {
     complex float symbol = 0.0f;
     
     for (size_t i = 0, j = index; i < EQ_LENGTH; i++, j++) {
         symbol += (in[j] * conjf(eq_coeff[i]));
     }
 
-    qpsk_demod(dibit, symbol);
+    /* Remove residual carrier phase before slicing */
+    symbol = track_derotate(symbol);
 
-    float i = (dibit[1] == 1) ? -1.0f : 1.0f; // I Odd
-    float q = (dibit[0] == 1) ? -1.0f : 1.0f; // Q Even
+    qpsk_demod_packed(bytes, symbol_index, symbol);
 
-    complex float constellation = i + q * I;
+    complex float constellation = qpsk_mod_packed(bytes, symbol_index);
 
-    /* Calculate error */
-    complex float error = (constellation - symbol) * 0.1f;
+    complex float back = track_update(symbol, constellation);
 
-    update_eq(in, index, error);
+    /* Calculate error, and rotate it back to the equalizer output */
+    complex float difference = constellation - symbol;
+    complex float error = difference * back * 0.1f;
 
-    *bits = (dibit[1] << 1) | dibit[0]; // IQ
+    error_power += cnormf(difference);
+    error_symbols++;
 
-    scramble(bits, rx);
+    update_eq(in, index, error);
 
     return crealf(error);
 }
+
+/*
+ * Returns the EVM and SNR of the data symbols since the last
+ * call, and resets for the next frame. The constellation
+ * points are +/-1 +/-j, so have a power of 2.
+ */
+void eq_frame(FrameQuality *quality) {
+    quality->symbols = error_symbols;
+
+    if (error_symbols > 0) {
+        float power = error_power / (float) error_symbols;
+
+        if (average_started == false) {
+            average_power = power;
+            average_started = true;
+        } else {
+            average_power += EQ_QUALITY_WEIGHT * (power - average_power);
+        }
+
+        quality->evm = sqrtf(power / 2.0f);
+        quality->snr = 10.0f * log10f(2.0f / fmaxf(power, 1e-12f));
+    } else {
+        quality->evm = 0.0f;
+        quality->snr = 0.0f;
+    }
+
+    quality->snr_average = (average_started == true) ?
+            10.0f * log10f(2.0f / fmaxf(average_power, 1e-12f)) : 0.0f;
+
+    error_power = 0.0f;
+    error_symbols = 0;
+}
+
+/*
+ * Start the running average again at each preamble,
+ * the burst may be another station
+ */
+void eq_quality_reset() {
+    error_power = 0.0f;
+    error_symbols = 0;
+    average_power = 0.0f;
+    average_started = false;
+}
@@ -33,29 +33,78 @@
  */
 
 #include <complex.h>
+#include <pthread.h>
 
 #include "fft.h"
+#include "fft_simd.h"
+#include "arena.h"
+
+/*
+ * Use the vector and direction specialised butterflies,
+ * false selects the original scalar code for comparison
+ */
+static bool use_simd = true;
+
+/*
+ * Plan cache, keyed by (nfft, inverse). The configs here are
+ * on the heap for the life of the program, and only read,
+ * each plan handed out shares their tables.
+ */
+
+struct fft_plan_entry {
+    int nfft;
+    int inverse;
+    fft_cfg cfg;
+};
+
+static struct fft_plan_entry plans[FFT_PLANS];
+static int plan_count;
+static pthread_mutex_t plan_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* Static prototypes/Forward declarations */
 
 static void kf_bfly2(complex float *, const size_t, const fft_cfg, int);
 static void kf_bfly4(complex float *, const size_t, const fft_cfg, const size_t);
+static void kf_bfly2_vec(complex float *, const size_t, const fft_cfg, int);
+static void kf_bfly4_forward(complex float *, const size_t, const fft_cfg, const size_t);
+static void kf_bfly4_inverse(complex float *, const size_t, const fft_cfg, const size_t);
 static void kf_bfly3(complex float *, const size_t, const fft_cfg, size_t);
 static void kf_bfly5(complex float *, const size_t, const fft_cfg, int);
 static void kf_bfly_generic(complex float *, const size_t, const fft_cfg, int, int);
 static void kf_work(complex float *, const complex float *, const size_t, int *, const fft_cfg);
 static void kf_factor(int, int *);
+static int kf_largest(int *);
 static void fft_stride(fft_cfg, const complex float *, complex float *);
+static void fft_radix2_inplace(fft_cfg, complex float *);
+#if FFT_VLEN > 0
+static void fft_radix2_lanes(fft_cfg, complex float *[], int, complex float []);
+#endif
 
 /* Public Functions */
 
 fft_cfg fft_alloc(int nfft, int inverse_fft, void *mem, size_t *lenmem) {
     fft_cfg st = NULL;
+    int factors[64];
+
+    kf_factor(nfft, factors);
+
+    /* largest radix, for the generic butterfly scratch */
+    int maxp = kf_largest(factors);
+
+    /*
+     * The scratch buffers are allocated with the config,
+     * so the transform itself never allocates memory
+     */
+    bool pow2 = (nfft > 1) && ((nfft & (nfft - 1)) == 0);
+
     size_t memneeded = sizeof (struct fft_state)
-            + sizeof (complex float) * (nfft - 1); /* twiddle factors*/
+            + sizeof (complex float) * nfft       /* twiddle factors*/
+            + sizeof (complex float) * nfft       /* in-place buffer */
+            + sizeof (complex float) * maxp       /* generic scratch */
+            + (pow2 ? sizeof (int) * nfft : 0);   /* bit reversal */
 
     if (lenmem == NULL) {
-        st = (fft_cfg) malloc(memneeded);
+        st = (fft_cfg) qpsk_malloc(memneeded);
     } else {
         if (mem != NULL && *lenmem >= memneeded)
             st = (fft_cfg) mem;
@@ -66,8 +115,31 @@ fft_cfg fft_alloc(int nfft, int inverse_fft, void *mem, size_t *lenmem) {
     if (st) {
         st->nfft = nfft;
         st->inverse = inverse_fft;
+        st->twiddles = (complex float *) (st + 1);
+        st->tmpbuf = st->twiddles + nfft;
+        st->scratch = st->tmpbuf + nfft;
+        st->bitrev = NULL;
+
+        if (pow2) {
+            int bits = 0;
 
-        for (size_t i = 0; i < nfft; i++) {
+            st->bitrev = (int *) (st->scratch + maxp);
+
+            while ((1 << bits) < nfft)
+                bits++;
+
+            for (int i = 0; i < nfft; i++) {
+                int r = 0;
+
+                for (int b = 0; b < bits; b++) {
+                    r |= ((i >> b) & 1) << (bits - 1 - b);
+                }
+
+                st->bitrev[i] = r;
+            }
+        }
+
+        for (int i = 0; i < nfft; i++) {
             float phase = -TAU * (float) i / (float) nfft;
 
             if (inverse_fft)
@@ -76,12 +148,19 @@ fft_cfg fft_alloc(int nfft, int inverse_fft, void *mem, size_t *lenmem) {
             *(st->twiddles + i) = cmplx(phase);
         }
 
-        kf_factor(nfft, st->factors);
+        memcpy(st->factors, factors, sizeof (factors));
     }
 
     return st;
 }
 
+/*
+ * Release a config from fft_alloc() or fftr_alloc() given no memory
+ */
+void fft_free(void *cfg) {
+    qpsk_free(cfg);
+}
+
 fftr_cfg fftr_alloc(int nfft, int inverse_fft, void *mem, size_t *lenmem) {
     fftr_cfg st = NULL;
     size_t subsize;
@@ -96,7 +175,7 @@ fftr_cfg fftr_alloc(int nfft, int inverse_fft, void *mem, size_t *lenmem) {
     size_t memneeded = sizeof (struct fftr_state) +subsize + sizeof (complex float) * (nfft * 3 / 2);
 
     if (lenmem == NULL) {
-        st = (fftr_cfg) malloc(memneeded);
+        st = (fftr_cfg) qpsk_malloc(memneeded);
     } else {
         if (*lenmem >= memneeded) {
             st = (fftr_cfg) mem;
@@ -115,7 +194,7 @@ fftr_cfg fftr_alloc(int nfft, int inverse_fft, void *mem, size_t *lenmem) {
 
     fft_alloc(nfft, inverse_fft, st->substate, &subsize);
 
-    for (size_t i = 0; i < nfft / 2; ++i) {
+    for (int i = 0; i < nfft / 2; ++i) {
         float phase = -M_PI * ((float) (i + 1) / (float) nfft + .5f);
 
         if (inverse_fft) {
@@ -134,6 +213,203 @@ void fft(fft_cfg cfg, const complex float *fin, complex float *fout) {
     fft_stride(cfg, fin, fout);
 }
 
+/*
+ * Complex FFT in place
+ *
+ * Power of two sizes use an iterative radix 2 transform that needs
+ * no buffer, so it may be run on one config from several threads.
+ * Other sizes go through the config in-place buffer.
+ */
+void fft_inplace(fft_cfg cfg, complex float *data) {
+    if (cfg->bitrev != NULL) {
+        fft_radix2_inplace(cfg, data);
+    } else {
+        fft_stride(cfg, data, data);
+    }
+}
+
+/*
+ * Complex FFT in place on count signals of the config size
+ *
+ * Power of two sizes transform FFT_VLEN signals at once, one per
+ * vector lane, interleaved in the work buffer. Other sizes run
+ * one at a time through the work buffer.
+ *
+ * The work buffer is FFT_MANY_WORK(nfft) long. Power of two sizes
+ * only read the config, so a thread pool can split the signals
+ * between threads, each with its own work buffer. Other sizes with
+ * a factor above 5 also write the config scratch, the same as
+ * fft(), so each thread then needs its own plan from fft_plan().
+ */
+void fft_many(fft_cfg st, complex float *signals[], int count, complex float work[]) {
+    const int n = st->nfft;
+
+    if (st->bitrev == NULL) {
+        for (int i = 0; i < count; i++) {
+            kf_work(work, signals[i], 1, st->factors, st);
+            memcpy(signals[i], work, sizeof (complex float) * n);
+        }
+
+        return;
+    }
+
+#if FFT_VLEN > 0
+    if (use_simd) {
+        for (int i = 0; i < count; i += FFT_VLEN) {
+            int lanes = count - i;
+
+            if (lanes > FFT_VLEN)
+                lanes = FFT_VLEN;
+
+            fft_radix2_lanes(st, &signals[i], lanes, work);
+        }
+
+        return;
+    }
+#endif
+
+    for (int i = 0; i < count; i++) {
+        fft_radix2_inplace(st, signals[i]);
+    }
+}
+
+/*
+ * Complex FFT in place on split real and imaginary arrays
+ *
+ * Power of two sizes only, returns false otherwise. The separate
+ * arrays let the compiler vectorise the butterflies on any target.
+ */
+bool fft_split(fft_cfg st, float re[], float im[]) {
+    const int n = st->nfft;
+
+    if (st->bitrev == NULL)
+        return false;
+
+    for (int i = 0; i < n; i++) {
+        int j = st->bitrev[i];
+
+        if (j > i) {
+            float t = re[i];
+
+            re[i] = re[j];
+            re[j] = t;
+
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+
+    for (int size = 2; size <= n; size <<= 1) {
+        const int half = size >> 1;
+        const int step = n / size;
+
+        for (int start = 0; start < n; start += size) {
+            float *restrict ar = &re[start];
+            float *restrict ai = &im[start];
+            float *restrict br = &re[start + half];
+            float *restrict bi = &im[start + half];
+
+            for (int k = 0; k < half; k++) {
+                float wr = crealf(st->twiddles[k * step]);
+                float wi = cimagf(st->twiddles[k * step]);
+                float tr = (br[k] * wr) - (bi[k] * wi);
+                float ti = (br[k] * wi) + (bi[k] * wr);
+
+                br[k] = ar[k] - tr;
+                bi[k] = ai[k] - ti;
+                ar[k] = ar[k] + tr;
+                ai[k] = ai[k] + ti;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Select the vector butterflies (the default), or the
+ * original scalar butterflies for comparison
+ */
+void fft_set_simd(bool choice) {
+    use_simd = choice;
+}
+
+/*
+ * Returns a config for (nfft, inverse) sharing the twiddles and bit
+ * reversal table of the cached one, which is created on first use.
+ *
+ * The in-place and scratch buffers are written by the transform, so
+ * each call gets its own. Take one plan per user, or per thread, at
+ * setup. With an arena created the plan is taken from it, sized with
+ * fft_plan_memory(), else from the heap. Returns NULL if the cache
+ * or the arena is full, or there is no memory.
+ */
+fft_cfg fft_plan(int nfft, int inverse) {
+    fft_cfg shared = NULL;
+
+    pthread_mutex_lock(&plan_lock);
+
+    for (int i = 0; i < plan_count; i++) {
+        if (plans[i].nfft == nfft && plans[i].inverse == inverse) {
+            shared = plans[i].cfg;
+            break;
+        }
+    }
+
+    if (shared == NULL && plan_count < FFT_PLANS) {
+        shared = fft_alloc(nfft, inverse, NULL, NULL);
+
+        if (shared != NULL) {
+            plans[plan_count].nfft = nfft;
+            plans[plan_count].inverse = inverse;
+            plans[plan_count].cfg = shared;
+            plan_count++;
+        }
+    }
+
+    pthread_mutex_unlock(&plan_lock);
+
+    if (shared == NULL)
+        return NULL;
+
+    size_t length = fft_plan_memory(nfft);
+    fft_cfg cfg;
+
+    if (arena_ready() == true) {
+        cfg = (fft_cfg) arena_alloc(length);
+    } else {
+        cfg = (fft_cfg) qpsk_malloc(length);
+    }
+
+    if (cfg != NULL) {
+        *cfg = *shared;
+        cfg->tmpbuf = (complex float *) (cfg + 1);
+        cfg->scratch = cfg->tmpbuf + nfft;
+    }
+
+    return cfg;
+}
+
+/*
+ * Release a plan, its arena memory goes with the arena
+ */
+void fft_plan_free(fft_cfg cfg) {
+    if (cfg != NULL && arena_owns(cfg) == false)
+        qpsk_free(cfg);
+}
+
+/*
+ * Returns the memory each plan of nfft points takes
+ */
+size_t fft_plan_memory(int nfft) {
+    int factors[64];
+
+    kf_factor(nfft, factors);
+
+    return sizeof (struct fft_state) + sizeof (complex float) * (nfft + kf_largest(factors));
+}
+
 /* Real FFT Forward */
 
 void encode_fftr(fftr_cfg st, const float *timedata, complex float *freqdata) {
@@ -148,7 +424,7 @@ void encode_fftr(fftr_cfg st, const float *timedata, complex float *freqdata) {
     freqdata[0] = (crealf(tdc) + cimagf(tdc)) + 0.0f * I;
     freqdata[ncfft] = (crealf(tdc) - cimagf(tdc)) + 0.0f * I;
 
-    for (size_t k = 1; k <= (ncfft / 2); k++) {
+    for (int k = 1; k <= (ncfft / 2); k++) {
         fpk = st->tmpbuf[k];
         fpnk = conjf(st->tmpbuf[ncfft - k]);
 
@@ -171,7 +447,7 @@ void encode_fftri(fftr_cfg st, const complex float *freqdata, float *timedata) {
     st->tmpbuf[0] = (crealf(freqdata[0]) + crealf(freqdata[ncfft])) +
             (crealf(freqdata[0]) - crealf(freqdata[ncfft])) * I;
 
-    for (size_t k = 1; k <= (ncfft / 2); k++) {
+    for (int k = 1; k <= (ncfft / 2); k++) {
         fk = freqdata[k];
         fnkc = conjf(freqdata[ncfft - k]);
 
@@ -254,6 +530,130 @@ static void kf_bfly4(
     } while (--k);
 }
 
+/*
+ * Radix 2 with FFT_VLEN butterflies per step,
+ * the twiddles are gathered at the stage stride
+ */
+static void kf_bfly2_vec(
+        complex float *Fout,
+        const size_t fstride,
+        const fft_cfg st,
+        int m) {
+    complex float *Fout2 = Fout + m;
+    const complex float *tw = st->twiddles;
+    int k = 0;
+
+#if FFT_VLEN > 0
+    for (; (k + FFT_VLEN) <= m; k += FFT_VLEN) {
+        fft_vec t = v_cmul(v_load(&Fout2[k]), v_gather(&tw[k * fstride], fstride));
+        fft_vec a = v_load(&Fout[k]);
+
+        v_store(&Fout2[k], v_sub(a, t));
+        v_store(&Fout[k], v_add(a, t));
+    }
+#endif
+
+    for (; k < m; k++) {
+        complex float w = tw[k * fstride];
+        float tr = (crealf(Fout2[k]) * crealf(w)) - (cimagf(Fout2[k]) * cimagf(w));
+        float ti = (crealf(Fout2[k]) * cimagf(w)) + (cimagf(Fout2[k]) * crealf(w));
+        complex float t = tr + ti * I;
+
+        Fout2[k] = Fout[k] - t;
+        Fout[k] = Fout[k] + t;
+    }
+}
+
+static inline complex float kf_cmul(complex float a, complex float b) {
+    return ((crealf(a) * crealf(b)) - (cimagf(a) * cimagf(b))) +
+            ((crealf(a) * cimagf(b)) + (cimagf(a) * crealf(b))) * I;
+}
+
+/*
+ * Radix 4 with the direction fixed at compile time, so the
+ * forward and inverse versions have no branch in the loop
+ */
+static inline void kf_bfly4_vec(
+        complex float *Fout,
+        const size_t fstride,
+        const fft_cfg st,
+        const size_t m,
+        const bool inverse) {
+    const complex float *tw = st->twiddles;
+    const size_t m2 = 2 * m;
+    const size_t m3 = 3 * m;
+    size_t k = 0;
+
+#if FFT_VLEN > 0
+    for (; (k + FFT_VLEN) <= m; k += FFT_VLEN) {
+        fft_vec s0 = v_cmul(v_load(&Fout[m + k]), v_gather(&tw[k * fstride], fstride));
+        fft_vec s1 = v_cmul(v_load(&Fout[m2 + k]), v_gather(&tw[k * fstride * 2], fstride * 2));
+        fft_vec s2 = v_cmul(v_load(&Fout[m3 + k]), v_gather(&tw[k * fstride * 3], fstride * 3));
+        fft_vec f0 = v_load(&Fout[k]);
+
+        fft_vec s5 = v_sub(f0, s1);
+        f0 = v_add(f0, s1);
+
+        fft_vec s3 = v_add(s0, s2);
+        fft_vec s4 = v_mulj(v_sub(s0, s2));
+
+        v_store(&Fout[m2 + k], v_sub(f0, s3));
+        v_store(&Fout[k], v_add(f0, s3));
+
+        if (inverse) {
+            v_store(&Fout[m + k], v_add(s5, s4));
+            v_store(&Fout[m3 + k], v_sub(s5, s4));
+        } else {
+            v_store(&Fout[m + k], v_sub(s5, s4));
+            v_store(&Fout[m3 + k], v_add(s5, s4));
+        }
+    }
+#endif
+
+    for (; k < m; k++) {
+        complex float s0 = kf_cmul(Fout[m + k], tw[k * fstride]);
+        complex float s1 = kf_cmul(Fout[m2 + k], tw[k * fstride * 2]);
+        complex float s2 = kf_cmul(Fout[m3 + k], tw[k * fstride * 3]);
+        complex float f0 = Fout[k];
+
+        complex float s5 = f0 - s1;
+        f0 = f0 + s1;
+
+        complex float s3 = s0 + s2;
+        complex float s4 = s0 - s2;
+
+        /* j * s4 */
+        s4 = -cimagf(s4) + crealf(s4) * I;
+
+        Fout[m2 + k] = f0 - s3;
+        Fout[k] = f0 + s3;
+
+        if (inverse) {
+            Fout[m + k] = s5 + s4;
+            Fout[m3 + k] = s5 - s4;
+        } else {
+            Fout[m + k] = s5 - s4;
+            Fout[m3 + k] = s5 + s4;
+        }
+    }
+}
+
+static void kf_bfly4_forward(
+        complex float *Fout,
+        const size_t fstride,
+        const fft_cfg st,
+        const size_t m) {
+    kf_bfly4_vec(Fout, fstride, st, m, false);
+}
+
+static void kf_bfly4_inverse(
+        complex float *Fout,
+        const size_t fstride,
+        const fft_cfg st,
+        const size_t m) {
+    kf_bfly4_vec(Fout, fstride, st, m, true);
+}
+
 static void kf_bfly3(
         complex float *Fout,
         const size_t fstride,
@@ -306,7 +706,7 @@ static void kf_bfly5(
     Fout3 = Fout0 + 3 * m;
     Fout4 = Fout0 + 4 * m;
 
-    for (size_t u = 0; u < m; u++) {
+    for (int u = 0; u < m; u++) {
         scratch[0] = *Fout0;
 
         scratch[1] = *Fout1 * tw[fstride * u];
@@ -353,22 +753,22 @@ static void kf_bfly_generic(
     complex float t;
     int Norig = st->nfft;
 
-    complex float *scratch = (complex float *) malloc(sizeof (complex float) * p);
+    complex float *scratch = st->scratch;
 
-    for (size_t u = 0; u < m; u++) {
+    for (int u = 0; u < m; u++) {
         int k = u;
 
-        for (size_t q1 = 0; q1 < p; q1++) {
+        for (int q1 = 0; q1 < p; q1++) {
             scratch[q1] = Fout[ k ];
             k += m;
         }
 
         k = u;
-        for (size_t q1 = 0; q1 < p; q1++) {
+        for (int q1 = 0; q1 < p; q1++) {
             int twidx = 0;
             Fout[ k ] = scratch[0];
 
-            for (size_t q = 1; q < p; q++) {
+            for (int q = 1; q < p; q++) {
                 twidx += fstride * k;
 
                 if (twidx >= Norig)
@@ -381,8 +781,6 @@ static void kf_bfly_generic(
             k += m;
         }
     }
-
-    free(scratch);
 }
 
 static void kf_work(
@@ -414,13 +812,21 @@ static void kf_work(
     // recombine the p smaller DFTs
     switch (p) {
         case 2:
-            kf_bfly2(Fout, fstride, st, m);
+            if (use_simd)
+                kf_bfly2_vec(Fout, fstride, st, m);
+            else
+                kf_bfly2(Fout, fstride, st, m);
             break;
         case 3:
             kf_bfly3(Fout, fstride, st, m);
             break;
         case 4:
-            kf_bfly4(Fout, fstride, st, m);
+            if (use_simd == false)
+                kf_bfly4(Fout, fstride, st, m);
+            else if (st->inverse)
+                kf_bfly4_inverse(Fout, fstride, st, m);
+            else
+                kf_bfly4_forward(Fout, fstride, st, m);
             break;
         case 5:
             kf_bfly5(Fout, fstride, st, m);
@@ -458,15 +864,114 @@ static void kf_factor(int n, int *facbuf) {
     } while (n > 1);
 }
 
-static void fft_stride(fft_cfg st, const complex float *fin, complex float *fout) {
-    if (fin == fout) {
-        complex float *tmpbuf = (complex float *) malloc(sizeof (complex float) * st->nfft);
+/*
+ * Returns the largest radix of the factors
+ */
+static int kf_largest(int *factors) {
+    int maxp = 0;
 
-        kf_work(tmpbuf, fin, 1, st->factors, st);
-        memcpy(fout, tmpbuf, sizeof (complex float) * st->nfft);
+    for (size_t i = 0; ; i += 2) {
+        if (factors[i] > maxp)
+            maxp = factors[i];
 
-        free(tmpbuf);
+        if (factors[i + 1] == 1)
+            break;
+    }
+
+    return maxp;
+}
+
+static void fft_stride(fft_cfg st, const complex float *fin, complex float *fout) {
+    if (fin == fout) {
+        kf_work(st->tmpbuf, fin, 1, st->factors, st);
+        memcpy(fout, st->tmpbuf, sizeof (complex float) * st->nfft);
     } else {
         kf_work(fout, fin, 1, st->factors, st);
     }
 }
+
+/*
+ * Iterative decimation in time radix 2, in place after a
+ * bit reversed reordering, using only the config twiddles
+ */
+static void fft_radix2_inplace(fft_cfg st, complex float *data) {
+    const int n = st->nfft;
+
+    for (int i = 0; i < n; i++) {
+        int j = st->bitrev[i];
+
+        if (j > i) {
+            complex float t = data[i];
+
+            data[i] = data[j];
+            data[j] = t;
+        }
+    }
+
+    for (int size = 2; size <= n; size <<= 1) {
+        const int half = size >> 1;
+        const int step = n / size;
+
+        if (use_simd && (half >= FFT_VLEN)) {
+            for (int start = 0; start < n; start += size) {
+                kf_bfly2_vec(&data[start], step, st, half);
+            }
+
+            continue;
+        }
+
+        for (int start = 0; start < n; start += size) {
+            complex float *a = &data[start];
+            complex float *b = &data[start + half];
+
+            for (int k = 0; k < half; k++) {
+                complex float t = b[k] * st->twiddles[k * step];
+
+                b[k] = a[k] - t;
+                a[k] = a[k] + t;
+            }
+        }
+    }
+}
+
+/*
+ * Radix 2 across the vector lanes, one signal per lane, so every
+ * butterfly shares one broadcast twiddle. The bit reversal is done
+ * while interleaving into the work buffer. Unused lanes are zero.
+ */
+#if FFT_VLEN > 0
+static void fft_radix2_lanes(fft_cfg st, complex float *signals[], int lanes, complex float work[]) {
+    const int n = st->nfft;
+
+    for (int i = 0; i < n; i++) {
+        int j = st->bitrev[i];
+
+        for (int l = 0; l < FFT_VLEN; l++) {
+            work[(i * FFT_VLEN) + l] = (l < lanes) ? signals[l][j] : 0.0f;
+        }
+    }
+
+    for (int size = 2; size <= n; size <<= 1) {
+        const int half = size >> 1;
+        const int step = n / size;
+
+        for (int start = 0; start < n; start += size) {
+            for (int k = 0; k < half; k++) {
+                complex float *a = &work[(start + k) * FFT_VLEN];
+                complex float *b = &work[(start + k + half) * FFT_VLEN];
+                fft_vec t = v_cmul(v_load(b), v_splat(&st->twiddles[k * step]));
+                fft_vec x = v_load(a);
+
+                v_store(b, v_sub(x, t));
+                v_store(a, v_add(x, t));
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        for (int l = 0; l < lanes; l++) {
+            signals[l][i] = work[(i * FFT_VLEN) + l];
+        }
+    }
+}
+#endif
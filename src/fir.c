@@ -26,7 +26,7 @@ void fir(complex float memory[], bool choice, complex float sample[], int length
         coeff = alpha35_root;
     }
 
-    for (size_t j = 0; j < length; j++) {
+    for (int j = 0; j < length; j++) {
         for (int i = 0; i < (NTAPS - 1); i++) {
             memory[i] = memory[i + 1];
         }
@@ -41,4 +41,45 @@ void fir(complex float memory[], bool choice, complex float sample[], int length
 
         sample[j] = y * GAIN;
     }
-}
\ No newline at end of file
+}
+
+/*
+ * Complex bandpass coefficients for a real input.
+ *
+ * This is the lowpass translated up to freq, so filtering the real
+ * samples and mixing the output down by freq is the same as mixing
+ * every input sample down and using the lowpass. The mix can then
+ * be done after decimation, at the symbol rate.
+ */
+void fir_bandpass(complex float bandpass[], bool choice, float freq) {
+    const float *lowpass;
+
+    if (choice == true) {
+        lowpass = alpha50_root;
+    } else {
+        lowpass = alpha35_root;
+    }
+
+    for (size_t i = 0; i < NTAPS; i++) {
+        float phase = TAU * freq * (float) ((NTAPS - 1) - i) / FS;
+
+        bandpass[i] = cmplx(phase) * (lowpass[i] * GAIN);
+    }
+}
+
+/*
+ * Bandpass filter real samples, computing only the output at
+ * index, from sample[index - (NTAPS - 1)] through sample[index]
+ */
+complex float fir_real(const complex float bandpass[], const float sample[], int index) {
+    const float *x = &sample[index - (NTAPS - 1)];
+    float yr = 0.0f;
+    float yi = 0.0f;
+
+    for (size_t i = 0; i < NTAPS; i++) {
+        yr += (crealf(bandpass[i]) * x[i]);
+        yi += (cimagf(bandpass[i]) * x[i]);
+    }
+
+    return yr + yi * I;
+}
@@ -0,0 +1,80 @@
+/*
+ * histogram.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Log bucketed histogram of durations
+ *
+ * Each power of two is split into HISTOGRAM_SUB buckets, so any
+ * percentile is within about 6 percent of the true value, and
+ * adding a value is a count of leading zeros and an increment.
+ */
+
+#include "histogram.h"
+
+// Functions
+
+/*
+ * Bucket of a value
+ */
+static int bucket(uint64_t value) {
+    if (value < HISTOGRAM_SUB)
+        return (int) value;
+
+    int e = 63 - __builtin_clzll(value);
+    int b = ((e - 2) * HISTOGRAM_SUB) + (int) ((value >> (e - 3)) & (HISTOGRAM_SUB - 1));
+
+    return (b < HISTOGRAM_BUCKETS) ? b : HISTOGRAM_BUCKETS - 1;
+}
+
+/*
+ * Value at the middle of a bucket
+ */
+static double bucket_value(int b) {
+    if (b < HISTOGRAM_SUB)
+        return (double) b;
+
+    int e = (b / HISTOGRAM_SUB) + 2;
+    double low = (double) ((uint64_t) (HISTOGRAM_SUB + (b % HISTOGRAM_SUB)) << (e - 3));
+
+    return low + ((double) (1ULL << (e - 3)) / 2.0);
+}
+
+void histogram_reset(Histogram *h) {
+    memset(h, 0, sizeof (Histogram));
+}
+
+void histogram_add(Histogram *h, uint64_t value) {
+    h->counts[bucket(value)]++;
+    h->count++;
+    h->total += value;
+
+    if (value > h->max)
+        h->max = value;
+}
+
+double histogram_mean(Histogram *h) {
+    return (h->count > 0) ? (double) h->total / (double) h->count : 0.0;
+}
+
+/*
+ * Value below which fraction of the values fall, 0 when empty,
+ * and never more than the largest value added
+ */
+double histogram_percentile(Histogram *h, double fraction) {
+    uint64_t target = (uint64_t) ceil(fraction * (double) h->count);
+    uint64_t sum = 0;
+
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        sum += h->counts[b];
+
+        if (sum >= target && sum > 0) {
+            double value = bucket_value(b);
+
+            return (value < (double) h->max) ? value : (double) h->max;
+        }
+    }
+
+    return 0.0;
+}
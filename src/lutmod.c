@@ -0,0 +1,158 @@
+/*
+ * lutmod.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Lookup table pulse shaping modulator
+ *
+ * With the symbols zero padded to 8 kHz, only one tap in five of the
+ * root raised cosine filter sees a symbol, and each output sample
+ * depends only on the last LUT_SPAN symbols. As there are only four
+ * QPSK symbols, the filtered contribution of every byte of four packed
+ * symbols is precomputed for each of the five output phases.
+ *
+ * Each output sample is then the sum of LUT_GROUPS table entries,
+ * rather than NTAPS multiplies. The mix to the center frequency is
+ * left to the block NCO, so the tables do not depend on CENTER.
+ */
+
+#include "lutmod.h"
+
+// Externals
+
+extern const float alpha35_root[];
+extern const float alpha50_root[];
+
+// Locals
+
+static const float *coeff;
+
+/*
+ * Filtered contribution of each byte of packed symbols
+ * for each output phase and symbol group
+ */
+static complex float table[CYCLESF][LUT_GROUPS][256];
+
+/*
+ * Last symbols sent, newest in the low bits, and how
+ * many are valid since reset
+ */
+static uint32_t history;
+static int count;
+
+// Functions
+
+/*
+ * Tap weighting symbol (m - j) for output phase p of symbol m
+ */
+static float tap(int p, int j) {
+    int d = p + (j * CYCLESF);
+
+    if (d >= NTAPS) {
+        return 0.0f;
+    }
+
+    return coeff[(NTAPS - 1) - d] * GAIN;
+}
+
+void lutmod_reset() {
+    history = 0;
+    count = 0;
+}
+
+/*
+ * Build the tables
+ * true = (wide) alpha50_root
+ * false = (narrow) alpha35_root
+ */
+void lutmod_init(bool choice) {
+    if (choice == true) {
+        coeff = alpha50_root;
+    } else {
+        coeff = alpha35_root;
+    }
+
+    for (int p = 0; p < CYCLESF; p++) {
+        for (int g = 0; g < LUT_GROUPS; g++) {
+            for (int b = 0; b < 256; b++) {
+                uint8_t byte = (uint8_t) b;
+                complex float sum = 0.0f;
+
+                for (int t = 0; t < LUT_GROUP; t++) {
+                    sum += qpsk_mod_packed(&byte, t) * tap(p, (g * LUT_GROUP) + t);
+                }
+
+                table[p][g][b] = sum;
+            }
+        }
+    }
+
+    lutmod_reset();
+}
+
+/*
+ * Output sample for phase p, summing the taps directly.
+ * Only used until the history is full after a reset.
+ */
+static complex float direct(int p) {
+    complex float sum = 0.0f;
+
+    for (int j = 0; (j < count) && (j < LUT_SPAN); j++) {
+        uint8_t dibit = (history >> (j * 2)) & 0x3;
+
+        sum += qpsk_mod_packed(&dibit, 0) * tap(p, j);
+    }
+
+    return sum;
+}
+
+/*
+ * Pulse shape the packed symbols starting at symbol index,
+ * returning (length * CYCLES) baseband samples
+ */
+void lutmod_modulate(complex float out[], uint8_t bytes[], int index, int length) {
+    for (int i = 0; i < length; i++) {
+        int symbol = index + i;
+        uint8_t dibit = (bytes[symbol >> 2] >> ((symbol & 0x3) * 2)) & 0x3;
+
+        history = (history << 2) | dibit;
+
+        if (count < LUT_SPAN) {
+            count++;
+
+            for (int p = 0; p < CYCLESF; p++) {
+                out[(i * CYCLESF) + p] = direct(p);
+            }
+
+            continue;
+        }
+
+        for (int p = 0; p < CYCLESF; p++) {
+            complex float sum = 0.0f;
+
+            for (int g = 0; g < LUT_GROUPS; g++) {
+                sum += table[p][g][(history >> (g * 8)) & 0xFF];
+            }
+
+            out[(i * CYCLESF) + p] = sum;
+        }
+    }
+}
+
+/*
+ * Shift the packed symbols starting at symbol index into the
+ * history without output, for when the samples are already known
+ */
+void lutmod_skip(uint8_t bytes[], int index, int length) {
+    for (int i = 0; i < length; i++) {
+        int symbol = index + i;
+        uint8_t dibit = (bytes[symbol >> 2] >> ((symbol & 0x3) * 2)) & 0x3;
+
+        history = (history << 2) | dibit;
+
+        if (count < LUT_SPAN) {
+            count++;
+        }
+    }
+}
@@ -0,0 +1,309 @@
+/*
+ * metrics.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Modem health metrics in the Prometheus text format
+ *
+ * The receiver counts frames, syncs, likely false syncs, end of burst
+ * transitions, squelched frames, the preamble match distribution and
+ * CPU time, and sets
+ * gauges for the carrier, tracking and signal quality, all with relaxed
+ * atomic stores into a ModemMetrics. It never waits on anything here.
+ *
+ * An export thread formats a snapshot every period, writing it to a
+ * file (through a temporary and a rename, as the node exporter text
+ * file collector expects), or with a target of "unix:path" serving
+ * it to each connection on a Unix stream socket.
+ */
+
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "metrics.h"
+
+// Defines
+
+#define UNIX_PREFIX     "unix:"
+
+// Locals
+
+static const int match_bounds[METRICS_MATCH_BUCKETS] = METRICS_MATCH_BOUNDS;
+
+static ModemMetrics *export_metrics;
+static char export_path[108];
+static bool export_socket;
+static int export_period;
+static int export_listen = -1;
+static int export_stop[2] = { -1, -1 };
+static pthread_t export_thread;
+
+// Functions
+
+void metrics_init(ModemMetrics *m, const char *name) {
+    memset(m, 0, sizeof (ModemMetrics));
+    snprintf(m->name, METRICS_NAME, "%s", name);
+}
+
+void metrics_add(atomic_uint_fast64_t *counter, uint64_t value) {
+    atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+void metrics_set(atomic_uint_fast64_t *gauge, double value) {
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof (bits));
+    atomic_store_explicit(gauge, bits, memory_order_relaxed);
+}
+
+double metrics_get(atomic_uint_fast64_t *gauge) {
+    uint64_t bits = atomic_load_explicit(gauge, memory_order_relaxed);
+    double value;
+
+    memcpy(&value, &bits, sizeof (value));
+
+    return value;
+}
+
+/*
+ * Count the preamble matches of a frame
+ */
+void metrics_matches(ModemMetrics *m, int matches) {
+    int i = 0;
+
+    while (i < METRICS_MATCH_BUCKETS && matches > match_bounds[i]) {
+        i++;
+    }
+
+    metrics_add(&m->matches[i], 1);
+    metrics_add(&m->matches_sum, (uint64_t) matches);
+}
+
+static void append(char text[], int size, int *length, const char *format, ...) {
+    va_list args;
+
+    if (*length >= size)
+        return;
+
+    va_start(args, format);
+    *length += vsnprintf(&text[*length], size - *length, format, args);
+    va_end(args);
+}
+
+static void counter(char text[], int size, int *length, ModemMetrics *m,
+        const char *name, const char *help, uint64_t value) {
+    append(text, size, length, "# HELP %s %s\n# TYPE %s counter\n%s{modem=\"%s\"} %llu\n",
+            name, help, name, name, m->name, (unsigned long long) value);
+}
+
+static void gauge(char text[], int size, int *length, ModemMetrics *m,
+        const char *name, const char *help, double value) {
+    append(text, size, length, "# HELP %s %s\n# TYPE %s gauge\n%s{modem=\"%s\"} %.9g\n",
+            name, help, name, name, m->name, value);
+}
+
+#define LOAD(field)     atomic_load_explicit(&m->field, memory_order_relaxed)
+
+/*
+ * Snapshot of the metrics as Prometheus text, returns the length,
+ * which is size or more when truncated
+ */
+int metrics_format(ModemMetrics *m, char text[], int size) {
+    int length = 0;
+
+    text[0] = '\0';
+
+    counter(text, size, &length, m, "qpsk_rx_frames_total", "Frames received.", LOAD(frames));
+    counter(text, size, &length, m, "qpsk_rx_syncs_total", "Preambles detected.", LOAD(syncs));
+    counter(text, size, &length, m, "qpsk_rx_false_syncs_total",
+            "Preambles detected with a weak correlation peak, likely false.", LOAD(false_syncs));
+    counter(text, size, &length, m, "qpsk_rx_eof_total", "End of burst transitions to hunting.", LOAD(eof));
+    counter(text, size, &length, m, "qpsk_rx_squelched_total", "Frames skipped by the squelch.", LOAD(squelched));
+
+    append(text, size, &length, "# HELP qpsk_rx_cpu_seconds_total Receive CPU time.\n"
+            "# TYPE qpsk_rx_cpu_seconds_total counter\n"
+            "qpsk_rx_cpu_seconds_total{modem=\"%s\"} %.9f\n", m->name, (double) LOAD(cpu_ns) / 1e9);
+
+    uint64_t total = 0;
+
+    append(text, size, &length, "# HELP qpsk_rx_preamble_matches Equalizer matches of the preamble per frame.\n"
+            "# TYPE qpsk_rx_preamble_matches histogram\n");
+
+    for (int i = 0; i < METRICS_MATCH_BUCKETS; i++) {
+        total += LOAD(matches[i]);
+        append(text, size, &length, "qpsk_rx_preamble_matches_bucket{modem=\"%s\",le=\"%d\"} %llu\n",
+                m->name, match_bounds[i], (unsigned long long) total);
+    }
+
+    total += LOAD(matches[METRICS_MATCH_BUCKETS]);
+
+    append(text, size, &length, "qpsk_rx_preamble_matches_bucket{modem=\"%s\",le=\"+Inf\"} %llu\n"
+            "qpsk_rx_preamble_matches_sum{modem=\"%s\"} %llu\n"
+            "qpsk_rx_preamble_matches_count{modem=\"%s\"} %llu\n",
+            m->name, (unsigned long long) total, m->name, (unsigned long long) LOAD(matches_sum),
+            m->name, (unsigned long long) total);
+
+    gauge(text, size, &length, m, "qpsk_rx_offset_hz", "Coarse carrier offset of the burst.", metrics_get(&m->offset));
+    gauge(text, size, &length, m, "qpsk_rx_frequency_hz", "Tracked carrier frequency.", metrics_get(&m->frequency));
+    gauge(text, size, &length, m, "qpsk_rx_track_error_radians", "Mean carrier phase error of the last frame.",
+            metrics_get(&m->track_error));
+    gauge(text, size, &length, m, "qpsk_rx_frame_cpu_seconds", "CPU time of the last frame.",
+            metrics_get(&m->frame_cpu));
+    gauge(text, size, &length, m, "qpsk_rx_snr_db", "SNR of the last frame from the equalizer error.",
+            metrics_get(&m->snr));
+    gauge(text, size, &length, m, "qpsk_rx_snr_average_db", "Running average SNR over the frames.",
+            metrics_get(&m->snr_average));
+    gauge(text, size, &length, m, "qpsk_rx_evm_ratio", "RMS error vector magnitude of the last frame.",
+            metrics_get(&m->evm));
+
+    return length;
+}
+
+/*
+ * Replace the file in one step, so a reader never sees half
+ */
+static void export_file(const char *text, int length) {
+    char temp[sizeof (export_path) + 8];
+
+    snprintf(temp, sizeof (temp), "%s.tmp", export_path);
+
+    FILE *out = fopen(temp, "w");
+
+    if (out == NULL)
+        return;
+
+    fwrite(text, 1, length, out);
+
+    if (fclose(out) == 0)
+        rename(temp, export_path);
+}
+
+static void *export(void *arg) {
+    static char text[METRICS_TEXT];
+    struct pollfd fds[2] = {
+        { export_stop[0], POLLIN, 0 },
+        { export_listen, POLLIN, 0 }
+    };
+
+    (void) arg;
+
+    while (1) {
+        int ready = poll(fds, export_socket ? 2 : 1, export_socket ? -1 : export_period);
+
+        if (ready < 0 && errno != EINTR)
+            break;
+
+        if (fds[0].revents != 0)
+            break;
+
+        int length = metrics_format(export_metrics, text, METRICS_TEXT);
+
+        if (length >= METRICS_TEXT)
+            length = METRICS_TEXT - 1;
+
+        if (export_socket == false) {
+            export_file(text, length);
+        } else if (fds[1].revents & POLLIN) {
+            int client = accept(export_listen, NULL, NULL);
+
+            if (client >= 0) {
+                send(client, text, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+                close(client);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Export m to target every period ms, a file path, or "unix:path"
+ * to answer each connection to a Unix socket with a snapshot
+ */
+bool metrics_export_start(ModemMetrics *m, const char *target, int period) {
+    if (export_metrics != NULL)
+        metrics_export_stop();
+
+    export_socket = (strncmp(target, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0);
+
+    if (export_socket)
+        target += strlen(UNIX_PREFIX);
+
+    if (strlen(target) >= sizeof (export_path))
+        return false;
+
+    strcpy(export_path, target);
+    export_period = (period > 0) ? period : METRICS_PERIOD_MS;
+
+    if (export_socket) {
+        struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+        strcpy(address.sun_path, export_path);
+        unlink(export_path);
+
+        if ((export_listen = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+            return false;
+
+        if (bind(export_listen, (struct sockaddr *) &address, sizeof (address)) != 0 ||
+                listen(export_listen, 4) != 0) {
+            close(export_listen);
+            export_listen = -1;
+            return false;
+        }
+    }
+
+    if (pipe(export_stop) != 0) {
+        metrics_export_stop();
+        return false;
+    }
+
+    export_metrics = m;
+
+    if (pthread_create(&export_thread, NULL, export, NULL) != 0) {
+        export_metrics = NULL;
+        metrics_export_stop();
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Stop the export thread, a file is written a last time
+ */
+void metrics_export_stop() {
+    static char text[METRICS_TEXT];
+
+    if (export_metrics != NULL) {
+        if (write(export_stop[1], "", 1) == 1)
+            pthread_join(export_thread, NULL);
+
+        if (export_socket == false) {
+            int length = metrics_format(export_metrics, text, METRICS_TEXT);
+
+            export_file(text, (length < METRICS_TEXT) ? length : METRICS_TEXT - 1);
+        }
+
+        export_metrics = NULL;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (export_stop[i] >= 0)
+            close(export_stop[i]);
+
+        export_stop[i] = -1;
+    }
+
+    if (export_listen >= 0) {
+        close(export_listen);
+        unlink(export_path);
+        export_listen = -1;
+    }
+}
@@ -0,0 +1,149 @@
+/*
+ * nco.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Block rotator Numerically Controlled Oscillator
+ *
+ * The old mixer multiplied a running phasor by a rotation on every
+ * sample, which is a serial recurrence that cannot be vectorized, and
+ * whose magnitude drifts so it must be normalized each frame.
+ *
+ * Here the phase is kept as a double precision accumulator, and only
+ * advanced once per block of NCO_BLOCK samples. Within the block each
+ * sample is the block phasor times a precomputed lane phasor, so every
+ * multiply is independent and the magnitude can never drift.
+ */
+
+#include "nco.h"
+
+// Functions
+
+/*
+ * Wrap phase into the range -PI to PI
+ */
+static double wrap_phase(double phase) {
+    return phase - (2.0 * M_PI) * floor((phase + M_PI) / (2.0 * M_PI));
+}
+
+/*
+ * Set the oscillator frequency, the current phase is kept
+ * so it can be retuned in the middle of a burst.
+ *
+ * freq can be negative to translate down to baseband
+ */
+void nco_set_frequency(NCO *nco, float freq, float fs) {
+    nco->step = wrap_phase(2.0 * M_PI * (double) freq / (double) fs);
+
+    /*
+     * Restart the exact reference from here,
+     * otherwise the error report becomes meaningless
+     */
+    nco->start = nco->phase;
+    nco->count = 0;
+
+    for (size_t k = 0; k < NCO_BLOCK; k++) {
+        nco->lanes[k] = cmplx((float) wrap_phase(nco->step * (double) k));
+    }
+}
+
+void nco_init(NCO *nco, float freq, float fs) {
+    nco->phase = 0.0;
+
+    nco_set_frequency(nco, freq, fs);
+}
+
+/*
+ * In-place multiply of the samples by the oscillator
+ */
+void nco_mix(NCO *nco, complex float samples[], int length) {
+    for (int n = 0; n < length; n += NCO_BLOCK) {
+        int block = length - n;
+
+        if (block > NCO_BLOCK)
+            block = NCO_BLOCK;
+
+        complex float base = cmplx((float) nco->phase);
+        complex float *out = &samples[n];
+
+        for (int k = 0; k < block; k++) {
+            out[k] *= (base * nco->lanes[k]);
+        }
+
+        nco->phase = wrap_phase(nco->phase + nco->step * (double) block);
+        nco->count += block;
+    }
+}
+
+/*
+ * In-place multiply of decimated samples by the oscillator
+ *
+ * samples[i] was taken at input sample (offset + i * decimate)
+ * counting from the current phase, and the oscillator is then
+ * advanced by span input samples.
+ */
+void nco_mix_decimated(NCO *nco, complex float samples[], int length,
+        int offset, int decimate, int span) {
+    complex float lanes[NCO_BLOCK];
+    double dstep = nco->step * (double) decimate;
+
+    for (size_t k = 0; k < NCO_BLOCK; k++) {
+        lanes[k] = cmplx((float) wrap_phase(dstep * (double) k));
+    }
+
+    for (int n = 0; n < length; n += NCO_BLOCK) {
+        int block = length - n;
+
+        if (block > NCO_BLOCK)
+            block = NCO_BLOCK;
+
+        double start = nco->phase + nco->step * (double) (offset + (n * decimate));
+        complex float base = cmplx((float) wrap_phase(start));
+        complex float *out = &samples[n];
+
+        for (int k = 0; k < block; k++) {
+            out[k] *= (base * lanes[k]);
+        }
+    }
+
+    nco->phase = wrap_phase(nco->phase + nco->step * (double) span);
+    nco->count += span;
+}
+
+/*
+ * Advance the oscillator by span samples without mixing
+ */
+void nco_advance(NCO *nco, int span) {
+    nco->phase = wrap_phase(nco->phase + nco->step * (double) span);
+    nco->count += span;
+}
+
+/*
+ * Returns the phasor that will be applied to the next sample
+ */
+complex float nco_phasor(NCO *nco) {
+    return cmplx((float) nco->phase);
+}
+
+/*
+ * Returns the largest phase error in radians over the next block,
+ * of the phasor the mixer applies (block phasor times lane phasor)
+ * against the exact (double precision) accumulated phase
+ */
+float nco_phase_error(NCO *nco) {
+    complex float base = cmplx((float) nco->phase);
+    double worst = 0.0;
+
+    for (size_t k = 0; k < NCO_BLOCK; k++) {
+        double exact = nco->start + nco->step * (double) (nco->count + k);
+        complex double ref = cos(exact) - sin(exact) * I;
+        complex float applied = base * nco->lanes[k];
+        double error = carg((complex double) applied * ref);
+
+        if (fabs(error) > fabs(worst))
+            worst = error;
+    }
+
+    return (float) worst;
+}
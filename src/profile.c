@@ -0,0 +1,114 @@
+/*
+ * profile.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Receiver stage timing
+ *
+ * With QPSK_PROFILE defined, qpsk_rx_frame() reads the time stamp
+ * counter (or the monotonic clock where there is none) between its
+ * stages and adds each interval to a histogram for the stage, at
+ * the cost of a bucket increment per stage. Without QPSK_PROFILE the
+ * marks compile to nothing and profile_stats() returns false.
+ */
+
+#include <time.h>
+
+#include "profile.h"
+#include "histogram.h"
+
+#ifdef QPSK_PROFILE
+
+// Locals
+
+static const char *stage_names[PROFILE_STAGES] = {
+    "convert", "fir", "mix", "acquire", "search", "equalize", "demod", "frame"
+};
+
+static Histogram histograms[PROFILE_STAGES];
+
+static double ns_per_tick;
+
+uint64_t profile_frame_start;
+uint64_t profile_last;
+
+// Functions
+
+void profile_mark(ProfileStage stage) {
+    uint64_t now = profile_ticks();
+
+    histogram_add(&histograms[stage], now - profile_last);
+    profile_last = now;
+}
+
+void profile_end() {
+    histogram_add(&histograms[profile_frame], profile_ticks() - profile_frame_start);
+}
+
+/*
+ * Ticks to nanoseconds, measured once against the monotonic clock
+ */
+static double calibrate() {
+#ifdef PROFILE_TSC
+    struct timespec t0, t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t start = profile_ticks();
+
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+    } while ((((t1.tv_sec - t0.tv_sec) * 1000000000LL) + (t1.tv_nsec - t0.tv_nsec)) < 20000000LL);
+
+    uint64_t ticks = profile_ticks() - start;
+
+    return (double) (((t1.tv_sec - t0.tv_sec) * 1000000000LL) + (t1.tv_nsec - t0.tv_nsec)) / (double) ticks;
+#else
+    return 1.0;
+#endif
+}
+
+/*
+ * Clear all the histograms
+ */
+void profile_reset() {
+    for (int i = 0; i < PROFILE_STAGES; i++) {
+        histogram_reset(&histograms[i]);
+    }
+}
+
+/*
+ * Statistics of a stage in nanoseconds, false if not profiling
+ */
+bool profile_stats(ProfileStage stage, ProfileStats *stats) {
+    if (stage < 0 || stage >= PROFILE_STAGES)
+        return false;
+
+    if (ns_per_tick == 0.0)
+        ns_per_tick = calibrate();
+
+    Histogram *h = &histograms[stage];
+
+    stats->name = stage_names[stage];
+    stats->count = h->count;
+    stats->mean = histogram_mean(h) * ns_per_tick;
+    stats->p50 = histogram_percentile(h, 0.50) * ns_per_tick;
+    stats->p99 = histogram_percentile(h, 0.99) * ns_per_tick;
+    stats->max = (double) h->max * ns_per_tick;
+
+    return true;
+}
+
+#else
+
+void profile_reset() {
+}
+
+bool profile_stats(ProfileStage stage, ProfileStats *stats) {
+    (void) stage;
+    (void) stats;
+
+    return false;
+}
+
+#endif
@@ -1,4 +1,3 @@
-#define DEBUG2
 /*
  * qpsk.c
  *
@@ -18,40 +17,132 @@
 #include "scramble.h"
 #include "fir.h"
 #include "fft.h"
+#include "nco.h"
+#include "acquire.h"
+#include "track.h"
+#include "lutmod.h"
+#include "arena.h"
+#include "resample.h"
+#include "profile.h"
+#include "trace.h"
+#include "histogram.h"
+#include "metrics.h"
 
 // Prototypes
 
 static float correlate(complex float [], int);
 static float magnitude(complex float [], int);
 static int equalize(complex float [], int);
+static int tx_output(int16_t [], complex float [], int, bool);
+static void rx_tune(float);
+static void rx_end_burst(void);
+static void preamble_init(void);
+static int rx_frame(int16_t [], uint8_t [], int64_t);
 
 // Externals
 
 extern const int8_t preamblevalues[];
 
-// Locals
+// Defines
+
+/*
+ * The receive history is kept in linear buffers several frames long.
+ * Each new frame is written after the last, and the window start moves
+ * along, so only when the buffer is full is the history copied back to
+ * the start, once every RX_BUFFER_FRAMES frames.
+ *
+ * The input window is the filter history, previous frame and new frame,
+ * and the decimated window is the previous frame and new frame.
+ */
+#define RX_BUFFER_FRAMES    8
 
-static FILE *fin;
-static FILE *fout;
+#define INPUT_HISTORY       ((NTAPS - 1) + FRAME_SIZE)
+#define INPUT_WINDOW        (INPUT_HISTORY + FRAME_SIZE)
+#define INPUT_BUFFER        (INPUT_HISTORY + (FRAME_SIZE * RX_BUFFER_FRAMES))
+
+#define DECIMATED_WINDOW    (DECIMATED_SIZE * 2)
+#define DECIMATED_BUFFER    (DECIMATED_SIZE + (DECIMATED_SIZE * RX_BUFFER_FRAMES))
+
+/*
+ * Symbols modulated at a time, callers may pass any length
+ */
+#define TX_BLOCK            PREAMBLE_LENGTH
+
+/*
+ * Resampled samples handled at a time by the audio interface
+ */
+#define AUDIO_CHUNK         1024
+
+/*
+ * Experimental RX Frequency Offset from TX
+ */
+#define FOFFSET 0.0f
+
+// Locals
 
 static RXState state;
 
 static complex float tx_filter[NTAPS];
-static complex float rx_filter[NTAPS];
-static complex float input_frame[(FRAME_SIZE * 2)];
-static complex float decimated_frame[562];
+static complex float *tx_signal;
+static complex float rx_bandpass[NTAPS];
+static float input_buffer[INPUT_BUFFER];
+static complex float decimated_buffer[DECIMATED_BUFFER];
+
 static complex float preambletable[PREAMBLE_LENGTH];
+static uint8_t preamblebytes[PREAMBLE_LENGTH / 4];
 
-// Two phase for full duplex
+/*
+ * Baseband preamble waveform after the filter history has
+ * cleared, the first LUT_SPAN symbols are not used
+ */
+static complex float preamblecache[PREAMBLE_SIZE];
 
-static complex float fbb_tx_phase;
-static complex float fbb_tx_rect;
+/*
+ * QPSK symbol for each dibit (I << 1) | Q
+ */
+static const complex float qpsk_symbols[] = {
+    1.0f + 1.0f * I,    // 00
+    1.0f - 1.0f * I,    // 01
+    -1.0f + 1.0f * I,   // 10
+    -1.0f - 1.0f * I    // 11
+};
+
+// Receive window start in the buffers
 
-static complex float fbb_rx_phase;
-static complex float fbb_rx_rect;
+static int input_offset;
+static int decimated_offset;
+
+// Two oscillators for full duplex
+
+static NCO tx_nco;
+static NCO rx_nco;
 
 static int rx_timing = FINE_TIMING_OFFSET;
 
+/*
+ * Coarse carrier offset (Hz) measured at the start of the burst,
+ * and the frames since, while waiting for the preamble sync
+ */
+static float rx_offset;
+static bool rx_acquired;
+static int rx_acquired_frames;
+
+/*
+ * Carrier tracking loop state of the last frame
+ */
+static TrackState rx_track;
+
+/*
+ * Data symbol quality of the last frame
+ */
+static FrameQuality rx_quality;
+
+/*
+ * Input sample at the center of the first symbol of the last
+ * preamble found, relative to the start of the frame it was in
+ */
+static int rx_sync;
+
 /*
  * Select which FIR coefficients
  * true = (wide) alpha50_root
@@ -59,16 +150,45 @@ static int rx_timing = FINE_TIMING_OFFSET;
  */
 static bool firwide = false;
 
-// Defines
+/*
+ * Sound card rates and converters, FS when not resampling
+ */
+static int rx_rate = (int) FS;
+static int tx_rate = (int) FS;
+static Resampler rx_resampler;
+static Resampler tx_resampler;
+static float audio_in[AUDIO_CHUNK];
+static float audio_out[AUDIO_CHUNK];
 
 /*
- * Experimental RX Frequency Offset from TX
+ * Receive samples at FS waiting for a whole frame
  */
-#define FOFFSET 0.0f
+static int16_t rx_audio_frame[FRAME_SIZE];
+static int rx_audio_fill;
 
-#ifdef DEBUG2
-int preamble_frames_detected = 0;
-#endif
+/*
+ * Timestamps of the last valid frame, and the latency
+ * of every valid frame since the last reset
+ */
+static RxTimes rx_times;
+static Histogram rx_latency[LATENCY_KINDS];
+
+/*
+ * Squelch threshold as a frame energy in squared PCM units, and
+ * whether the last frame was under it
+ */
+static double rx_squelch_energy;
+static bool rx_quiet;
+
+/*
+ * Receiver health, read by the metrics export thread
+ */
+static ModemMetrics rx_metrics;
+
+/*
+ * Frames received, numbering the trace records
+ */
+static uint32_t rx_frames;
 
 // Functions
 
@@ -95,13 +215,20 @@ static float correlate(complex float symbol[], int index) {
     return fabsf(cnormf(out));
 }
 
+/*
+ * Preamble correlation at index, for benchmarks
+ */
+float qpsk_correlate(complex float symbol[], int index) {
+    return correlate(symbol, index);
+}
+
 /*
  * Return magnitude of symbols (sans sqrt)
  */
 static float magnitude(complex float symbol[], int index) {
     float out = 0.0f;
 
-    for (size_t i = index; i < (PREAMBLE_LENGTH + index); i++) {
+    for (int i = index; i < (PREAMBLE_LENGTH + index); i++) {
         out += cnormf(symbol[i]);
     }
 
@@ -122,6 +249,67 @@ static int equalize(complex float symbol[], int index) {
     return match;
 }
 
+/*
+ * Monotonic nanoseconds, the clock of the RxTimes
+ */
+int64_t qpsk_now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((int64_t) ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+}
+
+static int64_t cpu_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return ((int64_t) ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+}
+
+/*
+ * Add the CPU time of a frame begun at cpu to the metrics
+ */
+static void rx_account(int64_t cpu) {
+    int64_t used = cpu_ns() - cpu;
+
+    metrics_add(&rx_metrics.cpu_ns, (uint64_t) used);
+    metrics_set(&rx_metrics.frame_cpu, (double) used / 1e9);
+}
+
+/*
+ * Retune the receiver oscillator and bandpass filter
+ *
+ * freq is the (negative) translation to baseband
+ */
+static void rx_tune(float freq) {
+    nco_set_frequency(&rx_nco, freq, FS);
+    fir_bandpass(rx_bandpass, firwide, -freq);
+}
+
+/*
+ * End of burst, back to hunting
+ */
+static void rx_end_burst() {
+    if (state == process)
+        metrics_add(&rx_metrics.eof, 1);
+
+    state = hunt;
+
+    /*
+     * Next burst may be another station
+     */
+    if (rx_acquired == true) {
+        rx_acquired = false;
+        rx_offset = 0.0f;
+
+        rx_tune(-CENTER + FOFFSET);
+
+        metrics_set(&rx_metrics.offset, 0.0);
+    }
+}
+
 /*
  * Receive function
  *
@@ -130,42 +318,135 @@ static int equalize(complex float symbol[], int index) {
  * Each frame is made up of 128 Preamble symbols and 31 x 8 Data symbols.
  * This is (128 * 5) = 640 + (31 * 5 * 8) = 1240 or 1880 samples per packet
  */
-int qpsk_rx_frame(int16_t in[], uint8_t bits[]) {
+int qpsk_rx_frame(int16_t in[], uint8_t bytes[]) {
+    return rx_frame(in, bytes, qpsk_now_ns());
+}
+
+/*
+ * Receive a frame whose last sample arrived at time arrival
+ */
+static int rx_frame(int16_t in[], uint8_t bytes[], int64_t arrival) {
+    int64_t cpu = cpu_ns();
+
+    PROFILE_BEGIN();
+
+    rx_frames++;
+    metrics_add(&rx_metrics.frames, 1);
+
     /*
-     * Convert input PCM to complex samples
-     * Translate to baseband at an 8 kHz sample rate
+     * Slide the windows along to the next frame
      */
-    for (size_t i = 0; i < FRAME_SIZE; i++) {
-        fbb_rx_phase *= fbb_rx_rect;
-
-        complex float val = fbb_rx_phase * ((float) in[i] / 16384.0f);
+    if ((input_offset + FRAME_SIZE + INPUT_WINDOW) > INPUT_BUFFER) {
+        memcpy(input_buffer, &input_buffer[input_offset + FRAME_SIZE], sizeof (float) * INPUT_HISTORY);
+        input_offset = 0;
+    } else {
+        input_offset += FRAME_SIZE;
+    }
 
-        input_frame[i] = input_frame[FRAME_SIZE + i];
-        input_frame[FRAME_SIZE + i] = val;
+    if ((decimated_offset + DECIMATED_SIZE + DECIMATED_WINDOW) > DECIMATED_BUFFER) {
+        memcpy(decimated_buffer, &decimated_buffer[decimated_offset + DECIMATED_SIZE],
+                sizeof (complex float) * DECIMATED_SIZE);
+        decimated_offset = 0;
+    } else {
+        decimated_offset += DECIMATED_SIZE;
     }
 
-    fbb_rx_phase /= cabsf(fbb_rx_phase); // normalize as magnitude can drift
+    float *input_frame = &input_buffer[input_offset];
+    complex float *decimated_frame = &decimated_buffer[decimated_offset];
 
     /*
-     * Raised Root Cosine Filter
+     * Convert input PCM to real samples, and sum the frame energy
      */
-    fir(rx_filter, firwide, input_frame, FRAME_SIZE);
+    int64_t energy = 0;
+
+    for (size_t i = 0; i < FRAME_SIZE; i++) {
+        input_frame[INPUT_HISTORY + i] = (float) in[i] / 16384.0f;
+        energy += (int32_t) in[i] * (int32_t) in[i];
+    }
+
+    PROFILE_MARK(profile_convert);
 
     /*
-     * Decimate by 5 to the 1600 symbol rate
+     * Squelch, through dead air only the input history is kept for
+     * the filter. With the previous frame quiet as well, the filter
+     * output over this frame is only noise, and is left as zeros in
+     * the decimated window. Any burst has ended.
      */
-    for (size_t i = 0; i < (FRAME_SIZE / CYCLES); i++) {
-        int extended = (FRAME_SIZE / CYCLES) + i; // compute once
+    bool was_quiet = rx_quiet;
+
+    rx_quiet = ((double) energy < rx_squelch_energy);
+
+    if (rx_quiet && was_quiet) {
+        rx_end_burst();
+
+        memset(&decimated_frame[DECIMATED_SIZE], 0, sizeof (complex float) * DECIMATED_SIZE);
+        nco_advance(&rx_nco, FRAME_SIZE);
+
+        metrics_add(&rx_metrics.squelched, 1);
+
+        PROFILE_END();
 
-        decimated_frame[i] = decimated_frame[extended];
-        decimated_frame[extended] = input_frame[(i * CYCLES) + rx_timing];
+        rx_account(cpu);
+
+        return 0;
+    }
+
+    /*
+     * Raised Root Cosine Bandpass Filter, decimate by 5 to the
+     * 1600 symbol rate computing only the samples kept
+     */
+    for (size_t i = 0; i < DECIMATED_SIZE; i++) {
+        decimated_frame[DECIMATED_SIZE + i] = fir_real(rx_bandpass, input_frame,
+                (NTAPS - 1) + (i * CYCLES) + rx_timing);
     }
+
+    PROFILE_MARK(profile_fir);
+
+    /*
+     * Translate to baseband at the symbol rate
+     */
+    nco_mix_decimated(&rx_nco, &decimated_frame[DECIMATED_SIZE],
+            DECIMATED_SIZE, rx_timing, CYCLES, FRAME_SIZE);
+
+    PROFILE_MARK(profile_mix);
     
-#ifdef TEST_SCATTER
-    for (int i = 0; i < (FRAME_SIZE / CYCLES); i++) {
-        fprintf(stderr, "%f %f\n", crealf(decimated_frame[i]), cimagf(decimated_frame[i]));
+    if (trace_enabled(trace_symbol) == true) {
+        for (int i = 0; i < DECIMATED_SIZE; i++) {
+            trace_write(trace_symbol, rx_frames, i, crealf(decimated_frame[i]), cimagf(decimated_frame[i]));
+        }
+
+        PROFILE_SKIP();
+    }
+
+    /*
+     * Coarse frequency acquisition, once per burst.
+     *
+     * Both frames in the window were mixed at the old frequency, so
+     * the offset is removed from the whole window. The correction is
+     * zero at the first input sample of the next frame, where the
+     * retuned oscillator takes over with the same phase, less the
+     * filter group delay, as the retuned bandpass filter moves its
+     * output phase by the offset over that delay.
+     */
+    if ((state == hunt) && (rx_acquired == false)) {
+        float offset;
+
+        if (acquire_offset(decimated_frame, 0, &offset) == true) {
+            acquire_derotate(decimated_frame, DECIMATED_WINDOW, offset,
+                    (float) DECIMATED_WINDOW - ((float) (rx_timing - ((NTAPS - 1) / 2)) / (float) CYCLES));
+
+            rx_acquired = true;
+            rx_acquired_frames = 0;
+            rx_offset = offset;
+            rx_tune(-CENTER + FOFFSET - rx_offset);
+
+            metrics_set(&rx_metrics.offset, rx_offset);
+        }
+
+        PROFILE_MARK(profile_acquire);
+    } else {
+        PROFILE_SKIP();
     }
-#endif
 
     /* Hunting for the preamble sequence */
 
@@ -182,6 +463,8 @@ int qpsk_rx_frame(int16_t in[], uint8_t bits[]) {
         }
     }
 
+    PROFILE_MARK(profile_search);
+
     // data mode equalizer reset before burst
     kalman_reset();
 
@@ -189,55 +472,311 @@ int qpsk_rx_frame(int16_t in[], uint8_t bits[]) {
 
     float mean = magnitude(decimated_frame, max_index);
 
-#ifdef DEBUG2
-    preamble_frames_detected++;
-#endif
+    PROFILE_MARK(profile_equalize);
+
+    trace_write(trace_peak, rx_frames, max_index, max_value, mean);
+    trace_write(trace_match, rx_frames, matches, 0.0f, 0.0f);
+    metrics_matches(&rx_metrics, matches);
 
     if ((matches > PREAMBLE_LENGTH - 30) /*&& (max_value > mean * 20.0f)*/) {
-#ifdef DEBUG2
-        printf("Frames: %d Matches: %d MaxIdx: %d MaxVal: %.2f Mean: %.2f\n",
-                preamble_frames_detected, matches, max_index, max_value, mean);
-#endif
+        int64_t sync_time = qpsk_now_ns();
+
+        metrics_add(&rx_metrics.syncs, 1);
+
+        if (max_value < (mean * METRICS_FALSE_SYNC))
+            metrics_add(&rx_metrics.false_syncs, 1);
+
         /*
          * Now process data symbols 
          */
         int sync_pos = max_index + PREAMBLE_LENGTH;
 
-        for (size_t i = 0, k = sync_pos, bindex = 0; i < DATA_SYMBOLS; i++, k++, bindex += 2) {
-            uint8_t dibit;
+        /*
+         * The window is the last two frames, and the
+         * filter output lags by half its length
+         */
+        rx_sync = (max_index * CYCLES) + rx_timing - (FRAME_SIZE * 2) - ((NTAPS - 1) / 2);
+
+        // carrier tracking and the signal quality restart on each preamble
+        track_reset();
+        eq_quality_reset();
 
-            data_eq(&dibit, decimated_frame, k);
+        float error = 0.0f;
 
-            // Bits are encoded [IQ,IQ,...,IQ]
+        // Bits are packed [IQ,IQ,...,IQ]
 
-            bits[bindex + 1] = dibit >> 1;      // I Odd
-            bits[bindex] = dibit & 0x1;         // Q Even
+        for (size_t i = 0, k = sync_pos; i < DATA_SYMBOLS; i++, k++) {
+            error += data_eq(bytes, i, decimated_frame, k);
         }
 
         state = process;
         
         rx_timing = sync_pos;           // TODO 
 
+        track_frame(&rx_track);
+        eq_frame(&rx_quality);
+
+        trace_write(trace_eq, rx_frames, DATA_SYMBOLS, error, rx_track.error);
+        trace_write(trace_sync, rx_frames, rx_timing, (float) rx_sync, rx_offset);
+
+        /*
+         * The last data symbol waited for the samples after it, to
+         * the end of this frame, before the frame was handed over.
+         * rx_sync is negative when the preamble began in an earlier
+         * frame, so the wait can be more than one frame.
+         */
+        int last = rx_sync + ((PREAMBLE_LENGTH + DATA_SYMBOLS - 1) * CYCLES);
+
+        rx_times.arrival = arrival;
+        rx_times.sync = sync_time;
+        rx_times.emit = qpsk_now_ns();
+        rx_times.buffered = (last < FRAME_SIZE) ? (FRAME_SIZE - 1 - last) : 0;
+
+        histogram_add(&rx_latency[latency_sync], sync_time - arrival);
+        histogram_add(&rx_latency[latency_emit], rx_times.emit - arrival);
+        histogram_add(&rx_latency[latency_bits], (rx_times.emit - arrival)
+                + (((int64_t) rx_times.buffered * 1000000000LL) / (int64_t) FS));
+
+        metrics_set(&rx_metrics.frequency, rx_track.frequency);
+        metrics_set(&rx_metrics.track_error, rx_track.error);
+        metrics_set(&rx_metrics.snr, rx_quality.snr);
+        metrics_set(&rx_metrics.snr_average, rx_quality.snr_average);
+        metrics_set(&rx_metrics.evm, rx_quality.evm);
+
+        PROFILE_MARK(profile_demod);
+        PROFILE_END();
+
+        rx_account(cpu);
+
         return 1;   // Valid frame
-    } else {
+    } else if (state == process) {
+        uint8_t discard[RX_BYTES];
+
         mean = 0.0f;
                 
         for (size_t i = 0, k = rx_timing; i < DATA_SYMBOLS; i++, k++) {
-            uint8_t dibit;
-
-            mean += data_eq(&dibit, decimated_frame, k);
+            mean += data_eq(discard, i, decimated_frame, k);
         }
         
         /* Check if reached the end of the frame */
 
+        track_frame(&rx_track);
+        eq_frame(&rx_quality);
+
+        trace_write(trace_eq, rx_frames, DATA_SYMBOLS, mean, rx_track.error);
+
+        metrics_set(&rx_metrics.frequency, rx_track.frequency);
+        metrics_set(&rx_metrics.track_error, rx_track.error);
+
         if (mean > EOF_COST_VALUE) {
-            state = hunt;
+            rx_end_burst();
         }
+
+        PROFILE_MARK(profile_demod);
+    } else {
+        /*
+         * Hunting, nothing to demodulate, and the carrier loop and
+         * signal quality are left alone. An offset acquired with
+         * no preamble sync following is dropped.
+         */
+        if ((rx_acquired == true) && (++rx_acquired_frames >= ACQ_HOLD))
+            rx_end_burst();
+
+        PROFILE_SKIP();
     }
 
+    PROFILE_END();
+
+    rx_account(cpu);
+
     return 0;   // defaults to invalid frame
 }
 
+/*
+ * Returns the carrier tracking loop state
+ * of the last frame received
+ */
+void qpsk_rx_track(TrackState *state) {
+    *state = rx_track;
+}
+
+/*
+ * Set the squelch level, the frame RMS in dB of full scale.
+ * Once two frames in a row are under it the receiver skips
+ * the DSP, in any state, and ends a burst in progress.
+ * -INFINITY turns it off, as qpsk_create() leaves it.
+ */
+void qpsk_rx_squelch(float level) {
+    rx_squelch_energy = (double) FRAME_SIZE * 32768.0 * 32768.0 * pow(10.0, (double) level / 10.0);
+}
+
+/*
+ * Returns the EVM and SNR of the data
+ * symbols of the last frame received
+ */
+void qpsk_rx_quality(FrameQuality *quality) {
+    *quality = rx_quality;
+}
+
+/*
+ * Returns the input sample at the center of the first symbol of
+ * the last preamble found, relative to the first sample of the
+ * frame it was found in. Negative is in an earlier frame.
+ */
+int qpsk_rx_sync() {
+    return rx_sync;
+}
+
+/*
+ * Returns the timestamps of the last valid frame
+ */
+void qpsk_rx_times(RxTimes *times) {
+    *times = rx_times;
+}
+
+/*
+ * Latency distribution of the valid frames since the last reset.
+ * The bits latency assumes the input arrives at the sample rate.
+ */
+void qpsk_rx_latency(LatencyKind kind, LatencyStats *stats) {
+    Histogram *h = &rx_latency[kind];
+
+    stats->count = h->count;
+    stats->mean = histogram_mean(h);
+    stats->p50 = histogram_percentile(h, 0.50);
+    stats->p99 = histogram_percentile(h, 0.99);
+    stats->max = (double) h->max;
+}
+
+void qpsk_rx_latency_reset() {
+    for (int i = 0; i < LATENCY_KINDS; i++) {
+        histogram_reset(&rx_latency[i]);
+    }
+}
+
+/*
+ * Returns the receiver metrics, for metrics_export_start()
+ */
+ModemMetrics *qpsk_metrics() {
+    return &rx_metrics;
+}
+
+/*
+ * Set the sound card sample rates, FS for none. With shared true
+ * the resamplers lean on the root raised cosine filters for the
+ * final band limit, and need about a third of the taps.
+ *
+ * Call before running, returns false if out of memory
+ */
+bool qpsk_audio_rates(int rx, int tx, bool shared) {
+    resample_free(&rx_resampler);
+    resample_free(&tx_resampler);
+
+    rx_rate = rx;
+    tx_rate = tx;
+    rx_audio_fill = 0;
+
+    if (rx_rate != (int) FS && resample_init(&rx_resampler, rx_rate, (int) FS, shared) == false) {
+        return false;
+    }
+
+    if (tx_rate != (int) FS && resample_init(&tx_resampler, (int) FS, tx_rate, shared) == false) {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Receive samples at the sound card rate, any length.
+ *
+ * The samples are resampled to FS, and each whole frame passed to
+ * qpsk_rx_frame(). Returns the number of valid frames, their
+ * payloads stored one after another, BYTES_PER_FRAME each.
+ */
+int qpsk_rx_audio(int16_t in[], int length, uint8_t bytes[]) {
+    int64_t arrival = qpsk_now_ns();
+    int frames = 0;
+    int chunk = length;
+
+    if (rx_rate != (int) FS) {
+        chunk = ((AUDIO_CHUNK - 1) * rx_resampler.down) / rx_resampler.up;
+
+        if (chunk > AUDIO_CHUNK) {
+            chunk = AUDIO_CHUNK;
+        }
+    }
+
+    for (int i = 0; i < length; i += chunk) {
+        int count = ((length - i) < chunk) ? (length - i) : chunk;
+        int16_t *samples = &in[i];
+
+        if (rx_rate != (int) FS) {
+            for (int j = 0; j < count; j++) {
+                audio_in[j] = (float) in[i + j];
+            }
+
+            count = resample_process(&rx_resampler, audio_in, count, audio_out);
+        }
+
+        for (int j = 0; j < count; j++) {
+            if (rx_rate != (int) FS) {
+                float sample = fmaxf(-32768.0f, fminf(32767.0f, audio_out[j]));
+
+                rx_audio_frame[rx_audio_fill++] = (int16_t) lrintf(sample);
+            } else {
+                rx_audio_frame[rx_audio_fill++] = samples[j];
+            }
+
+            if (rx_audio_fill == FRAME_SIZE) {
+                rx_audio_fill = 0;
+
+                if (rx_frame(rx_audio_frame, &bytes[frames * BYTES_PER_FRAME], arrival) == 1) {
+                    frames++;
+                }
+            }
+        }
+    }
+
+    return frames;
+}
+
+/*
+ * Convert transmit samples at FS to the sound card rate, returning
+ * the number written, at most (length * rate / FS) + 1 per call
+ */
+int qpsk_tx_audio(int16_t out[], int16_t in[], int length) {
+    if (tx_rate == (int) FS) {
+        memcpy(out, in, sizeof (int16_t) * length);
+        return length;
+    }
+
+    int chunk = ((AUDIO_CHUNK - 1) * tx_resampler.down) / tx_resampler.up;
+    int total = 0;
+
+    if (chunk > AUDIO_CHUNK) {
+        chunk = AUDIO_CHUNK;
+    }
+
+    for (int i = 0; i < length; i += chunk) {
+        int count = ((length - i) < chunk) ? (length - i) : chunk;
+
+        for (int j = 0; j < count; j++) {
+            audio_in[j] = (float) in[i + j];
+        }
+
+        count = resample_process(&tx_resampler, audio_in, count, audio_out);
+
+        for (int j = 0; j < count; j++) {
+            float sample = fmaxf(-32768.0f, fminf(32767.0f, audio_out[j]));
+
+            out[total++] = (int16_t) lrintf(sample);
+        }
+    }
+
+    return total;
+}
+
 /*
  * Gray coded QPSK modulation function
  *
@@ -271,46 +810,52 @@ void qpsk_demod(uint8_t bits[], complex float symbol) {
 }
 
 /*
- * Modulate the symbols by first upsampling to 8 kHz sample rate,
- * and translating the spectrum to 1100 Hz, where it is filtered
- * using the root raised cosine coefficients.
+ * Packed Gray coded QPSK modulation function
+ *
+ * Bits are packed [IQ,IQ,...,IQ] four symbols per byte, least
+ * significant first, so symbol n is the dibit (I << 1) | Q at
+ * bit position 2n
  */
-int qpsk_tx_frame(int16_t samples[], complex float symbol[], int length, bool preamble) {
-    complex float signal[(length * CYCLES)];
+complex float qpsk_mod_packed(uint8_t bytes[], int symbol) {
+    uint8_t dibit = (bytes[symbol >> 2] >> ((symbol & 0x3) * 2)) & 0x3;
 
-    /*
-     * Build the 1600 baud packet Frame zero padding
-     * for the desired 8 kHz sample rate.
-     */
-    for (size_t i = 0; i < length; i++) {
-        signal[(i * CYCLES)] = symbol[i];
+    return qpsk_symbols[dibit];
+}
 
-        for (size_t j = 1; j < CYCLES; j++) {
-            signal[(i * CYCLES) + j] = 0.0f;
-        }
-    }
+/*
+ * Packed Gray coded QPSK demodulation function
+ */
+void qpsk_demod_packed(uint8_t bytes[], int symbol, complex float value) {
+    uint8_t dibit = ((crealf(value) < 0.0f) << 1) | (cimagf(value) < 0.0f);
 
-    /*
-     * Raised Root Cosine Filter
-     */
-    fir(tx_filter, firwide, signal, (length * CYCLES));
+    qpsk_put_dibit(bytes, symbol, dibit);
+}
+
+/*
+ * Store a dibit (I << 1) | Q in a packed payload
+ */
+void qpsk_put_dibit(uint8_t bytes[], int symbol, uint8_t dibit) {
+    int shift = (symbol & 0x3) * 2;
+
+    bytes[symbol >> 2] = (uint8_t) ((bytes[symbol >> 2] & ~(0x3 << shift)) | (dibit << shift));
+}
 
+/*
+ * Translate the filtered baseband signal to the center
+ * frequency and return the resulting real samples
+ */
+static int tx_output(int16_t samples[], complex float signal[], int length, bool preamble) {
     /*
      * Shift Baseband to Center Frequency
      */
-    for (size_t i = 0; i < (length * CYCLES); i++) {
-        fbb_tx_phase *= fbb_tx_rect;
-        signal[i] *= fbb_tx_phase;
-    }
-
-    fbb_tx_phase /= cabsf(fbb_tx_phase); // normalize as magnitude can drift
+    nco_mix(&tx_nco, signal, (length * CYCLES));
 
     /*
      * Now return the resulting real samples
      * 
      * Make preamble 50% amplitude
      */
-    for (size_t i = 0; i < (length * CYCLES); i++) {
+    for (int i = 0; i < (length * CYCLES); i++) {
         if (preamble == true) {
             samples[i] = (int16_t) (crealf(signal[i]) * 8192.0f);
         } else {
@@ -322,143 +867,144 @@ int qpsk_tx_frame(int16_t samples[], complex float symbol[], int length, bool pr
 }
 
 /*
- * 128 Symbol Preamble
+ * Modulate the symbols by first upsampling to 8 kHz sample rate,
+ * and translating the spectrum to 1100 Hz, where it is filtered
+ * using the root raised cosine coefficients.
  */
-static int preamble_modulate(int16_t samples[]) {
-    return qpsk_tx_frame(samples, preambletable, PREAMBLE_LENGTH, true);
-}
+int qpsk_tx_frame(int16_t samples[], complex float symbol[], int length, bool preamble) {
+    for (int n = 0; n < length; n += TX_BLOCK) {
+        int block = length - n;
 
-/*
- * Bits are IQ,IQ,...,IQ
- */
-static int qpsk_modulate(int16_t samples[], uint8_t tx_bits[], int length) {
-    complex float symbol[length];
+        if (block > TX_BLOCK)
+            block = TX_BLOCK;
+
+        /*
+         * Build the 1600 baud packet Frame zero padding
+         * for the desired 8 kHz sample rate.
+         */
+        for (int i = 0; i < block; i++) {
+            tx_signal[(i * CYCLES)] = symbol[n + i];
+
+            for (size_t j = 1; j < CYCLES; j++) {
+                tx_signal[(i * CYCLES) + j] = 0.0f;
+            }
+        }
+
+        /*
+         * Raised Root Cosine Filter
+         */
+        fir(tx_filter, firwide, tx_signal, (block * CYCLES));
 
-    for (size_t i = 0, s = 0; i < length; i++, s += 2) {
-        symbol[i] = qpsk_mod(tx_bits, s);   // I Odd index, Q Even index
+        tx_output(&samples[n * CYCLES], tx_signal, block, preamble);
     }
 
-    return qpsk_tx_frame(samples, symbol, length, false);
+    return (length * CYCLES);
 }
 
-// Main Program
+/*
+ * Modulate packed symbols starting at symbol index, using
+ * the lookup table pulse shaping rather than the FIR filter.
+ */
+int qpsk_tx_packed(int16_t samples[], uint8_t bytes[], int index, int length, bool preamble) {
+    for (int n = 0; n < length; n += TX_BLOCK) {
+        int block = length - n;
 
-int main(int argc, char** argv) {
-    int16_t frame[FRAME_SIZE];
-    int16_t preamble[PREAMBLE_SIZE];
-    int length;
+        if (block > TX_BLOCK)
+            block = TX_BLOCK;
 
-    srand(time(0));
+        lutmod_modulate(tx_signal, bytes, index + n, block);
 
-    /*
-     * Encode BPSK preamble
-     *
-     *           | 0  +1+j1
-     *        ---+---
-     * -1-j1   1 |
-     *
-     */
+        tx_output(&samples[n * CYCLES], tx_signal, block, preamble);
+    }
+
+    return (length * CYCLES);
+}
+
+/*
+ * Build the preamble tables and baseband waveform
+ *
+ * BPSK preamble
+ *
+ *           | 0  +1+j1
+ *        ---+---
+ * -1-j1   1 |
+ *
+ */
+static void preamble_init() {
     for (size_t i = 0; i < PREAMBLE_LENGTH; i++) {
         float val = (float) preamblevalues[i];
 
         preambletable[i] = val + (val * I);
-    }
 
-    kalman_init();
-    scramble_init(both);
+        // +1+j1 is dibit 00, -1-j1 is dibit 11
 
-    /*
-     * Simulate the transmitted packets.
-     */
-    fout = fopen(TX_FILENAME, "wb");
-
-    fbb_tx_phase = cmplx(0.0f);
-    fbb_tx_rect = cmplx(TAU * CENTER / FS);
+        qpsk_put_dibit(preamblebytes, i, (val < 0.0f) ? 0x3 : 0x0);
+    }
 
-    uint8_t obits[(DATA_SYMBOLS * 2)];
+    lutmod_reset();
+    lutmod_modulate(preamblecache, preamblebytes, 0, PREAMBLE_LENGTH);
+    lutmod_reset();
+}
 
-    for (size_t k = 0; k < 10; k++) {
-        // Send preamble unscrambled
-        length = preamble_modulate(preamble);
-        
-        fwrite(preamble, sizeof (int16_t), length, fout);
+/*
+ * 128 Symbol Preamble
+ *
+ * Only the first LUT_SPAN symbols overlap the previous frame in the
+ * filter, after that the baseband is the same every time, and only
+ * has to be mixed to the current carrier phase.
+ */
+static int preamble_modulate(int16_t samples[]) {
+    lutmod_modulate(tx_signal, preamblebytes, 0, LUT_SPAN);
+    lutmod_skip(preamblebytes, LUT_SPAN, (PREAMBLE_LENGTH - LUT_SPAN));
 
-        //scramble_init(tx);
-        
-        /*
-         * NS data frames between each preamble frame
-         */
-        for (size_t j = 0; j < NS; j++) {
-            // 31 QPSK symbols scrambled
-            
-            for (size_t i = 0, s = 0; i < DATA_SYMBOLS; i++, s += 2) {
-                uint8_t sdata = ((rand() % 2) << 1) | (rand() % 2);
-                
-                // scramble(&sdata, tx); TODO
+    memcpy(&tx_signal[LUT_SPAN * CYCLES], &preamblecache[LUT_SPAN * CYCLES],
+            sizeof (complex float) * (PREAMBLE_SIZE - (LUT_SPAN * CYCLES)));
 
-                obits[s + 1] = (sdata >> 1) & 0x1;  // I Odd
-                obits[s] = sdata & 0x1;             // Q Even
-            }
+    return tx_output(samples, tx_signal, PREAMBLE_LENGTH, true);
+}
 
-            length = qpsk_modulate(frame, obits, DATA_SYMBOLS);
+/*
+ * Modulate the preamble, returning PREAMBLE_SIZE samples
+ */
+int qpsk_tx_preamble(int16_t samples[]) {
+    return preamble_modulate(samples);
+}
 
-            fwrite(frame, sizeof (int16_t), length, fout);
-        }
+/*
+ * Create the modem
+ *
+ * All working memory is taken from the arena here, so the transmit
+ * and receive functions never allocate. Returns false on failure.
+ */
+bool qpsk_create() {
+    size_t size = (sizeof (complex float) * TX_BLOCK * CYCLES) + ARENA_ALIGN
+            + acquire_memory() + ARENA_ALIGN;
 
-        // Dead space between packets
-        
-        int blank_frame[903] = { 0 };
-        
-        fwrite(blank_frame, sizeof (int16_t), 903, fout);    // some odd distance between packets
+    if (arena_create(size) == false) {
+        return false;
     }
 
-    fclose(fout);
+    tx_signal = (complex float *) arena_alloc(sizeof (complex float) * TX_BLOCK * CYCLES);
 
-    /*
-     * Now try to process what was transmitted
-     */
-    fin = fopen(TX_FILENAME, "rb");
+    kalman_init();
+    lutmod_init(firwide);
+    preamble_init();
+    track_init();
 
-    /*
-     * Save the received bits.
-     */
-    fout = fopen(RX_FILENAME, "wb");
+    if (acquire_init() == false) {
+        return false;
+    }
 
-    fbb_rx_phase = cmplx(0.0f);
-    fbb_rx_rect = cmplx(TAU * (-CENTER + FOFFSET) / FS);
+    scramble_init(both);
 
-    uint8_t ibits[BITS_PER_FRAME];
+    nco_init(&tx_nco, CENTER, FS);
+    nco_init(&rx_nco, (-CENTER + FOFFSET), FS);
+    fir_bandpass(rx_bandpass, firwide, (CENTER - FOFFSET));
 
     state = hunt;
 
-    scramble_init(rx);
-    
-    while (1) {
-        //scramble_init(rx);     TODO
-
-        /*
-         * Read in the frame samples
-         */
-        size_t count = fread(frame, sizeof (int16_t), FRAME_SIZE, fin);
-
-        if (count != FRAME_SIZE)
-            break;
-        
-        int valid = qpsk_rx_frame(frame, ibits);
-
-/* TODO
-        for (size_t i = 0; i < count; i++) {
-            scramble(&ibits[i], rx);
-        }
-*/
-
-        if (valid) {
-            fwrite(ibits, sizeof (uint8_t), BITS_PER_FRAME, fout);
-        }
-    }
-
-    fclose(fin);
-    fclose(fout);
+    metrics_init(&rx_metrics, "rx");
+    qpsk_rx_squelch(-INFINITY);
 
-    return (EXIT_SUCCESS);
+    return true;
 }
@@ -0,0 +1,180 @@
+/*
+ * resample.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Rational polyphase resampler
+ *
+ * The rate changes by L / M, so 48 kHz to 8 kHz is 1 / 6 and
+ * 44.1 kHz to 8 kHz is 80 / 441. Upsampling by L, filtering and
+ * keeping every M-th sample only needs, for each output, the one
+ * branch of the filter that lines up with real input samples.
+ *
+ * The lowpass is a Kaiser windowed sinc cut off at half the lower
+ * of the two rates. On its own it must pass 0.4 of that rate and
+ * stop at 0.5. The modem signal only reaches CENTER + 1080 Hz though,
+ * so when shared with the root raised cosine filter the transition
+ * can be the whole empty band between it and its image at the lower
+ * rate. Anything in there folds back outside the signal, where the
+ * receive filter removes it, so about a third of the taps do.
+ */
+
+#include "resample.h"
+#include "arena.h"
+
+// Defines
+
+/*
+ * Kaiser window beta, about 80 dB stopband. Aliases into the
+ * signal band measure -81 dB or better, see resample_bench
+ */
+#define RESAMPLE_BETA   8.0f
+
+// Functions
+
+static int gcd(int a, int b) {
+    while (b != 0) {
+        int t = a % b;
+
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/*
+ * Zeroth order modified Bessel function, for the Kaiser window
+ */
+static float bessel_i0(float x) {
+    float sum = 1.0f;
+    float term = 1.0f;
+
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2.0f * (float) k)) * (x / (2.0f * (float) k));
+        sum += term;
+
+        if (term < (sum * 1e-9f)) {
+            break;
+        }
+    }
+
+    return sum;
+}
+
+void resample_free(Resampler *r) {
+    qpsk_free(r->coeff);
+    qpsk_free(r->buffer);
+
+    r->coeff = NULL;
+    r->buffer = NULL;
+}
+
+void resample_reset(Resampler *r) {
+    for (int i = 0; i < r->length; i++) {
+        r->buffer[i] = 0.0f;
+    }
+
+    r->write = r->taps;
+    r->phase = 0;
+}
+
+/*
+ * Set up to convert from rate_in to rate_out (Hz),
+ * shared = true when the signal will be root raised
+ * cosine filtered at FS before or after.
+ *
+ * Returns false if out of memory.
+ */
+bool resample_init(Resampler *r, int rate_in, int rate_out, bool shared) {
+    int divisor = gcd(rate_in, rate_out);
+
+    r->up = rate_out / divisor;
+    r->down = rate_in / divisor;
+
+    int ratio = (r->down + r->up - 1) / r->up;
+
+    r->taps = ((shared == true) ? RESAMPLE_TAPS_SHARED : RESAMPLE_TAPS) * ratio;
+    r->length = r->taps + RESAMPLE_BUFFER;
+
+    int length = r->up * r->taps;
+
+    r->coeff = (float *) qpsk_malloc(sizeof (float) * length);
+    r->buffer = (float *) qpsk_malloc(sizeof (float) * r->length);
+
+    if (r->coeff == NULL || r->buffer == NULL) {
+        resample_free(r);
+        return false;
+    }
+
+    /*
+     * Cutoff (Hz) at the lower rate, then as a
+     * fraction of the upsampled rate
+     */
+    float low = (float) ((rate_in < rate_out) ? rate_in : rate_out);
+    float cutoff = (shared == true) ? (low / 2.0f) : (low * 0.45f);
+
+    cutoff /= (float) rate_in * (float) r->up;
+
+    float norm = bessel_i0(RESAMPLE_BETA);
+
+    for (int i = 0; i < length; i++) {
+        float t = (float) i - ((float) (length - 1) / 2.0f);
+        float x = 2.0f * t / (float) (length - 1);
+        float w = bessel_i0(RESAMPLE_BETA * sqrtf(fmaxf(0.0f, 1.0f - (x * x)))) / norm;
+        float s = (t == 0.0f) ? 2.0f * cutoff : sinf(TAU * cutoff * t) / (M_PI * t);
+
+        /*
+         * Branch p holds taps p, p + L, p + 2L ...
+         * the gain of L makes up for the zero stuffing
+         */
+        r->coeff[((i % r->up) * r->taps) + (i / r->up)] = s * w * (float) r->up;
+    }
+
+    resample_reset(r);
+
+    return true;
+}
+
+/*
+ * Most output samples produced from length input samples
+ */
+int resample_max_output(Resampler *r, int length) {
+    return (int) (((int64_t) length * r->up) / r->down) + 1;
+}
+
+/*
+ * Resample length input samples, returning the
+ * number of output samples, at most
+ * resample_max_output(length)
+ */
+int resample_process(Resampler *r, const float in[], int length, float out[]) {
+    int count = 0;
+
+    for (int i = 0; i < length; i++) {
+        if (r->write == r->length) {
+            memmove(r->buffer, &r->buffer[r->length - r->taps], sizeof (float) * r->taps);
+            r->write = r->taps;
+        }
+
+        r->buffer[r->write++] = in[i];
+
+        while (r->phase < r->up) {
+            const float *h = &r->coeff[r->phase * r->taps];
+            const float *x = &r->buffer[r->write - 1];
+            float sum = 0.0f;
+
+            for (int j = 0; j < r->taps; j++) {
+                sum += h[j] * x[-j];
+            }
+
+            out[count++] = sum;
+            r->phase += r->down;
+        }
+
+        r->phase -= r->up;
+    }
+
+    return count;
+}
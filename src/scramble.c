@@ -32,6 +32,10 @@
  * The scrambler is important for modems that don't use NRZI and bit-stuffing
  * 
  * Full-Duplex capable
+ *
+ * As the register is reset to the Sync Seed each frame, the keystream is
+ * the same every frame. It is generated once, 14 bits at a time, and the
+ * frame is then scrambled or descrambled with a single XOR per byte.
  */
 
 #include "scramble.h"
@@ -41,9 +45,19 @@
 static uint16_t TXMemory;
 static uint16_t RXMemory;
 
+/*
+ * Keystream of one frame from the Sync Seed
+ * bit k of the frame is (mask[k / 64] >> (k % 64)) & 1
+ */
+static uint64_t frame_mask[FRAME_WORDS];
+
 // Functions
 
 void scramble_init(SRegister sr) {
+    uint16_t memory = SEED;
+
+    scramble_keystream(&memory, frame_mask, FRAME_WORDS);
+
     if (sr == tx) {
         TXMemory = SEED;
     } else if (sr == rx) {
@@ -82,3 +96,65 @@ int scramble(uint8_t *input, SRegister sr) {
     
     return 0;
 }
+
+/*
+ * Generate keystream words from the register, 64 bits at a time.
+ *
+ * Register bit i is keystream bit (n + i), and the feedback makes
+ * bit (n + 15) = bit n ^ bit (n + 1), so one shift and XOR of the
+ * register gives the next 14 keystream bits at once.
+ */
+void scramble_keystream(uint16_t *memory, uint64_t words[], int length) {
+    uint64_t acc = 0;
+    int count = 0;
+    uint16_t m = *memory;
+
+    for (int i = 0; i < length; i++) {
+        while (count < 64) {
+            uint64_t next = (uint64_t) ((m ^ (m >> 1)) & 0x3FFF);
+
+            acc |= (next << count);
+            count += 14;
+
+            m = (uint16_t) ((m >> 14) | (next << 1));
+        }
+
+        words[i] = acc;
+
+        /*
+         * Carry the bits beyond this word into the next
+         */
+        count -= 64;
+        acc = (count > 0) ? (uint64_t) ((m >> (15 - count)) & ((1 << count) - 1)) : 0;
+    }
+
+    *memory = m;
+}
+
+/*
+ * In-place scramble or descramble of a frame payload
+ * packed in bytes, least significant bit first
+ *
+ * Byte k of the payload is byte k of the mask in little endian
+ * order, so whole words are XORed, then the tail byte by byte.
+ */
+void scramble_bytes(uint8_t bytes[], int length) {
+    int words = length >> 3;
+
+    for (int i = 0; i < words; i++) {
+        uint64_t word;
+        uint64_t mask = frame_mask[i];
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        mask = __builtin_bswap64(mask);
+#endif
+
+        memcpy(&word, &bytes[i * 8], sizeof (word));
+        word ^= mask;
+        memcpy(&bytes[i * 8], &word, sizeof (word));
+    }
+
+    for (int i = words * 8; i < length; i++) {
+        bytes[i] ^= (uint8_t) (frame_mask[i >> 3] >> ((i & 7) * 8));
+    }
+}
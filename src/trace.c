@@ -0,0 +1,175 @@
+/*
+ * trace.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Binary trace of the receiver
+ *
+ * The receiver writes fixed size records (constellation points,
+ * correlation peaks, equalizer matches and errors, timing) into a
+ * single producer, single consumer ring. A background thread drains
+ * the ring to a file every TRACE_DRAIN_MS, so the receive path only
+ * stores 16 bytes and bumps an index, and never blocks: with the ring
+ * full the record is dropped and counted. bench/trace_dump.c reads
+ * the file back.
+ *
+ * The ring is taken with qpsk_malloc() when the trace is first
+ * opened. When closed, or for record types not in the mask,
+ * trace_write() returns at once. The mask is atomic, as it is
+ * cleared by trace_close() while the receiver may be writing on
+ * another thread, and the ring is kept after the close, so a write
+ * already past the mask lands in live memory and is just lost.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "trace.h"
+#include "arena.h"
+
+// Defines
+
+#define RING_MASK   (TRACE_RING - 1)
+
+// Locals
+
+static TraceRecord *ring;
+static atomic_uint head;        // next record written, by the receiver
+static atomic_uint tail;        // next record drained, by the thread
+
+static atomic_uint trace_mask;
+static atomic_uint dropped;
+
+static FILE *trace_file;
+static pthread_t drain_thread;
+static atomic_bool draining;
+
+// Functions
+
+/*
+ * Write out everything in the ring, returns the records written
+ */
+static uint32_t flush() {
+    uint32_t t = atomic_load_explicit(&tail, memory_order_relaxed);
+    uint32_t h = atomic_load_explicit(&head, memory_order_acquire);
+    uint32_t n = h - t;
+
+    if (n == 0)
+        return 0;
+
+    uint32_t start = t & RING_MASK;
+    uint32_t first = (n < (TRACE_RING - start)) ? n : (TRACE_RING - start);
+
+    fwrite(&ring[start], sizeof (TraceRecord), first, trace_file);
+
+    if (n > first)
+        fwrite(ring, sizeof (TraceRecord), n - first, trace_file);
+
+    atomic_store_explicit(&tail, t + n, memory_order_release);
+
+    return n;
+}
+
+static void *drain(void *arg) {
+    struct timespec pause = { 0, TRACE_DRAIN_MS * 1000000L };
+
+    (void) arg;
+
+    while (atomic_load_explicit(&draining, memory_order_acquire) == true) {
+        if (flush() == 0)
+            nanosleep(&pause, NULL);
+    }
+
+    return NULL;
+}
+
+/*
+ * Start tracing the record types in mask to filename
+ */
+bool trace_open(const char *filename, uint32_t mask) {
+    if (trace_file != NULL)
+        trace_close();
+
+    if (ring == NULL && (ring = qpsk_malloc(sizeof (TraceRecord) * TRACE_RING)) == NULL)
+        return false;
+
+    if ((trace_file = fopen(filename, "wb")) == NULL)
+        return false;
+
+    uint32_t size = sizeof (TraceRecord);
+
+    fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), trace_file);
+    fwrite(&size, sizeof (uint32_t), 1, trace_file);
+
+    atomic_store(&head, 0);
+    atomic_store(&tail, 0);
+    atomic_store(&draining, true);
+    atomic_store(&dropped, 0);
+
+    if (pthread_create(&drain_thread, NULL, drain, NULL) != 0) {
+        fclose(trace_file);
+        trace_file = NULL;
+        return false;
+    }
+
+    atomic_store_explicit(&trace_mask, mask, memory_order_release);
+
+    return true;
+}
+
+/*
+ * Stop the thread, write what is left, and close the file
+ */
+void trace_close() {
+    if (trace_file == NULL)
+        return;
+
+    atomic_store_explicit(&trace_mask, 0, memory_order_release);
+
+    atomic_store_explicit(&draining, false, memory_order_release);
+    pthread_join(drain_thread, NULL);
+
+    flush();
+
+    uint32_t lost = atomic_load(&dropped);
+
+    if (lost > 0) {
+        TraceRecord record = { lost, trace_dropped, 0, 0.0f, 0.0f };
+
+        fwrite(&record, sizeof (TraceRecord), 1, trace_file);
+    }
+
+    fclose(trace_file);
+    trace_file = NULL;
+}
+
+bool trace_enabled(TraceType type) {
+    return (atomic_load_explicit(&trace_mask, memory_order_relaxed) & TRACE_MASK(type)) != 0;
+}
+
+/*
+ * Add a record, dropped when the ring is full
+ */
+void trace_write(TraceType type, uint32_t frame, int index, float a, float b) {
+    if ((atomic_load_explicit(&trace_mask, memory_order_acquire) & TRACE_MASK(type)) == 0)
+        return;
+
+    uint32_t h = atomic_load_explicit(&head, memory_order_relaxed);
+
+    if ((h - atomic_load_explicit(&tail, memory_order_acquire)) >= TRACE_RING) {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    TraceRecord *record = &ring[h & RING_MASK];
+
+    record->frame = frame;
+    record->type = (uint16_t) type;
+    record->index = (uint16_t) index;
+    record->a = a;
+    record->b = b;
+
+    atomic_store_explicit(&head, h + 1, memory_order_release);
+}
@@ -0,0 +1,116 @@
+/*
+ * track.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Decision directed second order carrier tracking loop
+ *
+ * The equalizer output is derotated by the loop phase before slicing,
+ * and the phase of the symbol against its decision drives a
+ * proportional plus integral loop filter. The equalizer can then
+ * stay trained on the channel, rather than chasing a residual
+ * frequency offset through the whole burst.
+ */
+
+#include "track.h"
+
+// Locals
+
+static float alpha;             // proportional gain
+static float beta;              // integral gain
+
+static float phase;             // radians
+static float frequency;         // radians per symbol
+static float frequency_limit;   // TRACK_RANGE in radians per symbol
+static complex float rotate;    // conjugate of the loop phase
+
+static float error_sum;
+static int error_count;
+
+// Functions
+
+/*
+ * Reset loop at the start of each burst
+ */
+void track_reset() {
+    phase = 0.0f;
+    frequency = 0.0f;
+    rotate = 1.0f;
+
+    error_sum = 0.0f;
+    error_count = 0;
+}
+
+/*
+ * Compute loop gains from the noise bandwidth and damping
+ */
+void track_init() {
+    float theta = TRACK_BW / (TRACK_DAMPING + (0.25f / TRACK_DAMPING));
+    float den = 1.0f + (2.0f * TRACK_DAMPING * theta) + (theta * theta);
+
+    alpha = (4.0f * TRACK_DAMPING * theta) / den;
+    beta = (4.0f * theta * theta) / den;
+
+    frequency_limit = TAU * TRACK_RANGE / RS;
+
+    track_reset();
+}
+
+/*
+ * Remove the loop phase from the equalized symbol
+ */
+complex float track_derotate(complex float symbol) {
+    return symbol * rotate;
+}
+
+/*
+ * Update the loop with the derotated symbol and its decision
+ *
+ * Returns the rotation to take an error in the derotated
+ * domain back to the equalizer domain.
+ */
+complex float track_update(complex float symbol, complex float decision) {
+    complex float back = conjf(rotate);
+
+    /*
+     * Phase detector, sin() of the angle between
+     * the symbol and decision, scaled by |decision|^2
+     */
+    float error = cimagf(symbol * conjf(decision)) / cnormf(decision);
+
+    frequency = fminf(fmaxf(frequency + (beta * error), -frequency_limit), frequency_limit);
+    phase += (frequency + (alpha * error));
+
+    if (phase > M_PI) {
+        phase -= TAU;
+    } else if (phase < -M_PI) {
+        phase += TAU;
+    }
+
+    rotate = cmplxconj(phase);
+
+    error_sum += fabsf(error);
+    error_count++;
+
+    return back;
+}
+
+/*
+ * Return the loop state for the frame, and
+ * clear the per frame error average
+ */
+void track_frame(TrackState *state) {
+    state->phase = phase;
+    state->frequency = frequency * RS / TAU;
+    state->symbols = error_count;
+
+    if (error_count > 0) {
+        state->error = error_sum / (float) error_count;
+    } else {
+        state->error = 0.0f;
+    }
+
+    error_sum = 0.0f;
+    error_count = 0;
+}
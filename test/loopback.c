@@ -0,0 +1,184 @@
+/*
+ * loopback.c
+ *
+ * Licensed under GNU LGPL V2.1
+ * See LICENSE file for information
+ *
+ * Loopback test of the modem
+ *
+ * Ten packets of random payload are written to TX_FILENAME, then
+ * read back through the receiver, and the payload of each valid
+ * frame written to RX_FILENAME. With TRACE_ENV set the receiver
+ * trace is written as well. Built with ALLOC_CHECK, it fails if
+ * the transmit or receive loop allocates.
+ *
+ *   make test
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "qpsk_internal.h"
+#include "scramble.h"
+#include "arena.h"
+#include "trace.h"
+
+int main(int argc, char** argv) {
+    int16_t frame[FRAME_SIZE];
+    int16_t preamble[PREAMBLE_SIZE];
+    int length;
+    FILE *fin;
+    FILE *fout;
+
+    /*
+     * The stdio buffers are given, so file
+     * I/O does not allocate once running
+     */
+    char in_buffer[BUFSIZ];
+    char out_buffer[BUFSIZ];
+
+#ifdef ALLOC_CHECK
+    int allocations = 0;
+#endif
+
+    (void) argc;
+    (void) argv;
+
+    srand(time(0));
+
+    if (qpsk_create() == false) {
+        fprintf(stderr, "Unable to allocate modem memory\n");
+        return (EXIT_FAILURE);
+    }
+
+    qpsk_rx_squelch(SQUELCH_LEVEL);
+
+    /*
+     * Receiver trace when asked for, read back with bench/trace_dump.c
+     */
+    const char *trace_name = getenv(TRACE_ENV);
+
+    if (trace_name != NULL) {
+        if (trace_name[0] == '\0')
+            trace_name = TRACE_FILENAME;
+
+        if (trace_open(trace_name, TRACE_ALL) == false)
+            fprintf(stderr, "Unable to open trace %s\n", trace_name);
+    }
+
+    /*
+     * Simulate the transmitted packets.
+     */
+    fout = fopen(TX_FILENAME, "wb");
+    setvbuf(fout, out_buffer, _IOFBF, BUFSIZ);
+
+    uint8_t obytes[BYTES_PER_FRAME];
+
+#ifdef ALLOC_CHECK
+    alloc_check_begin();
+#endif
+
+    for (size_t k = 0; k < 10; k++) {
+        // Send preamble unscrambled
+        length = qpsk_tx_preamble(preamble);
+        
+        fwrite(preamble, sizeof (int16_t), length, fout);
+
+        for (size_t i = 0; i < BYTES_PER_FRAME; i++) {
+            obytes[i] = (uint8_t) (rand() & 0xFF);
+        }
+
+        // Scrambler is reset to the sync seed each frame
+
+        scramble_bytes(obytes, BYTES_PER_FRAME);
+        
+        /*
+         * NS data frames between each preamble frame
+         */
+        for (size_t j = 0; j < NS; j++) {
+            // 31 QPSK symbols scrambled
+
+            length = qpsk_tx_packed(frame, obytes, (j * DATA_SYMBOLS), DATA_SYMBOLS, false);
+
+            fwrite(frame, sizeof (int16_t), length, fout);
+        }
+
+        // Dead space between packets
+        
+        int blank_frame[903] = { 0 };
+        
+        fwrite(blank_frame, sizeof (int16_t), 903, fout);    // some odd distance between packets
+    }
+
+#ifdef ALLOC_CHECK
+    allocations += alloc_check_end();
+#endif
+
+    fclose(fout);
+
+    /*
+     * Now try to process what was transmitted
+     */
+    fin = fopen(TX_FILENAME, "rb");
+    setvbuf(fin, in_buffer, _IOFBF, BUFSIZ);
+
+    /*
+     * Save the received bits.
+     */
+    fout = fopen(RX_FILENAME, "wb");
+    setvbuf(fout, out_buffer, _IOFBF, BUFSIZ);
+
+    uint8_t ibytes[BYTES_PER_FRAME] = { 0 };
+
+    scramble_init(rx);
+
+#ifdef ALLOC_CHECK
+    alloc_check_begin();
+#endif
+
+    while (1) {
+        /*
+         * Read in the frame samples
+         */
+        size_t count = fread(frame, sizeof (int16_t), FRAME_SIZE, fin);
+
+        if (count != FRAME_SIZE)
+            break;
+        
+        /*
+         * Only the first RX_BYTES are decoded, the rest stay zero
+         */
+        memset(ibytes, 0, BYTES_PER_FRAME);
+
+        int valid = qpsk_rx_frame(frame, ibytes);
+
+        if (valid) {
+            scramble_bytes(ibytes, RX_BYTES);
+
+            // clear the keystream from the bits after the last symbol
+
+            ibytes[RX_BYTES - 1] &= (uint8_t) (0xFF >> ((8 - ((DATA_SYMBOLS * 2) % 8)) % 8));
+
+            fwrite(ibytes, sizeof (uint8_t), BYTES_PER_FRAME, fout);
+        }
+    }
+
+#ifdef ALLOC_CHECK
+    allocations += alloc_check_end();
+#endif
+
+    fclose(fin);
+    fclose(fout);
+
+    trace_close();
+
+#ifdef ALLOC_CHECK
+    if (allocations != 0) {
+        fprintf(stderr, "FAIL: %d heap allocations in TX/RX\n", allocations);
+        return (EXIT_FAILURE);
+    }
+#endif
+
+    return (EXIT_SUCCESS);
+}